@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <QVector>
+#include <algorithm> // std::copy, std::copy_backward
+
+namespace FeatherPad {
+
+/* A vector of per-block values with a gap at the place of the last change
+   (a gap buffer). Since changes usually happen near each other, inserting
+   and removing blocks only moves the values between the old and new places
+   of the gap, not all the values after the change. */
+template <typename T>
+class BlockCache
+{
+public:
+    BlockCache() : gapStart_ (0), gapEnd_ (0) {}
+
+    int size() const {
+        return data_.size() - (gapEnd_ - gapStart_);
+    }
+    bool isEmpty() const {
+        return size() == 0;
+    }
+    void clear() {
+        data_.clear();
+        gapStart_ = gapEnd_ = 0;
+    }
+    void fill (const T &value, int count) {
+        data_.fill (value, count);
+        gapStart_ = gapEnd_ = count;
+    }
+
+    const T &at (int i) const {
+        return data_.at (i < gapStart_ ? i : i + gapEnd_ - gapStart_);
+    }
+    T &operator[] (int i) {
+        return data_[i < gapStart_ ? i : i + gapEnd_ - gapStart_];
+    }
+
+    void insert (int pos, int count, const T &value) {
+        if (count <= 0) return;
+        moveGap (pos);
+        if (gapEnd_ - gapStart_ < count)
+        { // grow the gap
+            const int grow = count + qMax (64, size() / 16);
+            data_.insert (gapEnd_, grow, value);
+            gapEnd_ += grow;
+        }
+        for (int i = 0; i < count; ++i)
+            data_[gapStart_ + i] = value;
+        gapStart_ += count;
+    }
+    void remove (int pos, int count) {
+        count = qMin (count, size() - pos);
+        if (count <= 0) return;
+        moveGap (pos);
+        gapEnd_ += count;
+    }
+
+private:
+    void moveGap (int pos) {
+        T *d = data_.data();
+        if (pos < gapStart_)
+        {
+            std::copy_backward (d + pos, d + gapStart_, d + gapEnd_);
+            gapEnd_ -= gapStart_ - pos;
+            gapStart_ = pos;
+        }
+        else if (pos > gapStart_)
+        {
+            const int n = pos - gapStart_;
+            std::copy (d + gapEnd_, d + gapEnd_ + n, d + gapStart_);
+            gapStart_ = pos;
+            gapEnd_ += n;
+        }
+    }
+
+    QVector<T> data_;
+    int gapStart_, gapEnd_; // the gap is [gapStart_, gapEnd_) in data_
+};
+
+}
+
+#endif // BLOCKCACHE_H
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "bracketindex.h"
+#include "highlighter.h"
+
+/* the minimum depth of an unknown block, which stops searches */
+#define UNKNOWN_DEPTH (-(1 << 28))
+
+namespace FeatherPad {
+
+BracketIndex::BracketIndex() : root_ (nullptr), seed_ (2463534242u) {}
+/*************************/
+BracketIndex::~BracketIndex()
+{
+    deleteTree (root_);
+}
+/*************************/
+int BracketIndex::size() const
+{
+    return nodeSize (root_);
+}
+/*************************/
+void BracketIndex::clear()
+{
+    deleteTree (root_);
+    root_ = nullptr;
+}
+/*************************/
+void BracketIndex::reset (int count)
+{
+    clear();
+    insertBlocks (0, count);
+}
+/*************************/
+BracketIndex::Node *BracketIndex::newNode()
+{
+    /* xorshift */
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+
+    Node *t = new Node;
+    t->left = t->right = nullptr;
+    t->priority = seed_;
+    t->size = 1;
+    for (int k = 0; k < 3; ++k)
+    {
+        t->own[k].sum = 0;
+        t->own[k].min = t->own[k].rmin = UNKNOWN_DEPTH;
+        t->all[k] = t->own[k];
+    }
+    return t;
+}
+/*************************/
+void BracketIndex::update (Node *t)
+{
+    t->size = 1 + nodeSize (t->left) + nodeSize (t->right);
+    for (int k = 0; k < 3; ++k)
+    {
+        Summary s = t->own[k];
+        if (t->left)
+        {
+            const Summary &l = t->left->all[k];
+            s.min = qMin (l.min, l.sum + s.min);
+            s.rmin = qMin (s.rmin, l.rmin - s.sum);
+            s.sum += l.sum;
+        }
+        if (t->right)
+        {
+            const Summary &r = t->right->all[k];
+            s.min = qMin (s.min, s.sum + r.min);
+            s.rmin = qMin (r.rmin, s.rmin - r.sum);
+            s.sum += r.sum;
+        }
+        t->all[k] = s;
+    }
+}
+/*************************/
+void BracketIndex::deleteTree (Node *t)
+{
+    if (!t) return;
+    deleteTree (t->left);
+    deleteTree (t->right);
+    delete t;
+}
+/*************************/
+BracketIndex::Node *BracketIndex::merge (Node *a, Node *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+    if (a->priority > b->priority)
+    {
+        a->right = merge (a->right, b);
+        update (a);
+        return a;
+    }
+    b->left = merge (a, b->left);
+    update (b);
+    return b;
+}
+/*************************/
+// Splits the tree into the first "pos" blocks and the rest.
+void BracketIndex::split (Node *t, int pos, Node *&a, Node *&b)
+{
+    if (!t)
+    {
+        a = b = nullptr;
+        return;
+    }
+    if (nodeSize (t->left) >= pos)
+    {
+        split (t->left, pos, a, t->left);
+        update (t);
+        b = t;
+    }
+    else
+    {
+        split (t->right, pos - nodeSize (t->left) - 1, t->right, b);
+        update (t);
+        a = t;
+    }
+}
+/*************************/
+void BracketIndex::insertBlocks (int pos, int count)
+{
+    if (count <= 0) return;
+    pos = qBound (0, pos, size());
+    Node *middle = nullptr;
+    for (int i = 0; i < count; ++i)
+        middle = merge (middle, newNode());
+    Node *a, *b;
+    split (root_, pos, a, b);
+    root_ = merge (merge (a, middle), b);
+}
+/*************************/
+void BracketIndex::removeBlocks (int pos, int count)
+{
+    if (count <= 0 || pos < 0 || pos >= size()) return;
+    Node *a, *b, *c;
+    split (root_, pos, a, b);
+    split (b, count, b, c);
+    deleteTree (b);
+    root_ = merge (a, c);
+}
+/*************************/
+bool BracketIndex::setNode (Node *t, int pos, const Summary *summaries)
+{
+    if (!t) return false;
+    int l = nodeSize (t->left);
+    bool res;
+    if (pos < l)
+        res = setNode (t->left, pos, summaries);
+    else if (pos > l)
+        res = setNode (t->right, pos - l - 1, summaries);
+    else
+    {
+        for (int k = 0; k < 3; ++k)
+            t->own[k] = summaries[k];
+        res = true;
+    }
+    if (res)
+        update (t);
+    return res;
+}
+/*************************/
+// Computes the nesting changes of a block from its bracket infos.
+template <class List>
+static void summarize (const List &infos, char open, int &sum, int &min, int &rmin)
+{
+    sum = min = rmin = 0;
+    for (int i = 0; i < infos.size(); ++i)
+    {
+        sum += infos.at (i).character == open ? 1 : -1;
+        min = qMin (min, sum);
+    }
+    int rsum = 0;
+    for (int i = infos.size() - 1; i >= 0; --i)
+    {
+        rsum += infos.at (i).character == open ? -1 : 1;
+        rmin = qMin (rmin, rsum);
+    }
+}
+
+void BracketIndex::setBlock (int pos, const TextBlockData *data)
+{
+    if (pos < 0 || pos >= size()) return;
+    Summary summaries[3];
+    if (data == nullptr)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            summaries[k].sum = 0;
+            summaries[k].min = summaries[k].rmin = UNKNOWN_DEPTH;
+        }
+    }
+    else
+    {
+        summarize (data->parentheses(), '(',
+                   summaries[Parenthesis].sum, summaries[Parenthesis].min, summaries[Parenthesis].rmin);
+        summarize (data->braces(), '{',
+                   summaries[Brace].sum, summaries[Brace].min, summaries[Brace].rmin);
+        summarize (data->brackets(), '[',
+                   summaries[Bracket].sum, summaries[Bracket].min, summaries[Bracket].rmin);
+    }
+    setNode (root_, pos, summaries);
+}
+/*************************/
+void BracketIndex::clearBlock (int pos)
+{
+    if (pos < 0 || pos >= size()) return;
+    Summary summaries[3];
+    for (int k = 0; k < 3; ++k)
+        summaries[k].sum = summaries[k].min = summaries[k].rmin = 0;
+    setNode (root_, pos, summaries);
+}
+/*************************/
+int BracketIndex::findForward (const Node *t, int offset, int from, int kind, int &depth)
+{
+    if (!t || offset + t->size <= from) return -1;
+    if (offset >= from && depth + t->all[kind].min >= 0)
+    { // nothing is closed in this subtree
+        depth += t->all[kind].sum;
+        return -1;
+    }
+    int res = findForward (t->left, offset, from, kind, depth);
+    if (res >= 0) return res;
+    int indx = offset + nodeSize (t->left);
+    if (indx >= from)
+    {
+        if (depth + t->own[kind].min < 0)
+            return indx;
+        depth += t->own[kind].sum;
+    }
+    return findForward (t->right, indx + 1, from, kind, depth);
+}
+/*************************/
+int BracketIndex::findBackward (const Node *t, int offset, int from, int kind, int &depth)
+{
+    if (!t || offset > from) return -1;
+    if (offset + t->size - 1 <= from && depth + t->all[kind].rmin >= 0)
+    { // nothing is opened in this subtree
+        depth -= t->all[kind].sum;
+        return -1;
+    }
+    int indx = offset + nodeSize (t->left);
+    int res = findBackward (t->right, indx + 1, from, kind, depth);
+    if (res >= 0) return res;
+    if (indx <= from)
+    {
+        if (depth + t->own[kind].rmin < 0)
+            return indx;
+        depth -= t->own[kind].sum;
+    }
+    return findBackward (t->left, offset, from, kind, depth);
+}
+/*************************/
+int BracketIndex::forwardMatch (int block, Kind kind, int &depth) const
+{
+    if (block + 1 >= size()) return -1;
+    int d = depth;
+    int res = findForward (root_, 0, block + 1, kind, d);
+    if (res >= 0)
+        depth = d;
+    return res;
+}
+/*************************/
+int BracketIndex::backwardMatch (int block, Kind kind, int &depth) const
+{
+    if (block <= 0 || block > size()) return -1;
+    int d = depth;
+    int res = findBackward (root_, 0, block - 1, kind, d);
+    if (res >= 0)
+        depth = d;
+    return res;
+}
+
+}
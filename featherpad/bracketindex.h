@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef BRACKETINDEX_H
+#define BRACKETINDEX_H
+
+#include <QtGlobal>
+
+namespace FeatherPad {
+
+class TextBlockData;
+
+/* A document-wide index of the nesting changes of parentheses, braces and
+   brackets, one entry per block. It's an implicit treap (a balanced tree
+   ordered by block numbers), whose nodes also keep the sums and minimum
+   prefix/suffix depths of their subtrees. So, the block in which a bracket
+   is matched can be found in logarithmic time and inserting, removing or
+   updating blocks takes logarithmic time too.
+
+   Blocks whose brackets aren't known (not highlighted yet) stop searches. */
+class BracketIndex
+{
+public:
+    enum Kind
+    {
+        Parenthesis = 0,
+        Brace,
+        Bracket
+    };
+
+    BracketIndex();
+    ~BracketIndex();
+
+    int size() const;
+    void clear();
+    /* makes the index have "count" unknown blocks */
+    void reset (int count);
+    void insertBlocks (int pos, int count);
+    void removeBlocks (int pos, int count);
+    /* a null "data" means that the brackets of the block aren't known */
+    void setBlock (int pos, const TextBlockData *data);
+    /* for a block without brackets */
+    void clearBlock (int pos);
+
+    /* Finds the first block after "block" in which the nesting depth goes
+       below zero, "depth" being the number of unmatched opening brackets at
+       the end of "block". On success, "depth" will be the number of them at
+       the start of the found block. Returns -1 if there's no such block.
+       If an unknown block comes first, its number is returned. */
+    int forwardMatch (int block, Kind kind, int &depth) const;
+    /* The same as forwardMatch() but for closing brackets and in reverse. */
+    int backwardMatch (int block, Kind kind, int &depth) const;
+
+private:
+    struct Summary
+    {
+        int sum; // opening minus closing brackets
+        int min; // the minimum of prefix sums (<= 0)
+        int rmin; // the minimum of reverse suffix sums (<= 0)
+    };
+    struct Node
+    {
+        Node *left;
+        Node *right;
+        quint32 priority;
+        int size;
+        Summary own[3];
+        Summary all[3]; // of the subtree
+    };
+
+    Node *newNode();
+    static int nodeSize (const Node *t) {return t ? t->size : 0;}
+    static void update (Node *t);
+    static void deleteTree (Node *t);
+    static Node *merge (Node *a, Node *b);
+    static void split (Node *t, int pos, Node *&a, Node *&b);
+    static bool setNode (Node *t, int pos, const Summary *summaries);
+    static int findForward (const Node *t, int offset, int from, int kind, int &depth);
+    static int findBackward (const Node *t, int offset, int from, int kind, int &depth);
+
+    Node *root_;
+    quint32 seed_;
+};
+
+}
+
+#endif // BRACKETINDEX_H
@@ -19,11 +19,13 @@
 
 #include "fpwin.h"
 #include "ui_fp.h"
+#include "framestats.h"
 
 namespace FeatherPad {
 
 void FPwin::matchBrackets()
 {
+    FrameTimer frameTimer (FrameStats::Brackets);
     int index = ui->tabWidget->currentIndex();
     if (index == -1) return;
     TextEdit *textEdit = qobject_cast< TabPage *>(ui->tabWidget->widget (index))->textEdit();
@@ -55,25 +57,25 @@ void FPwin::matchBrackets()
     bool findNextBrace (!isAtLeft || !isAtRight);
     if (isAtLeft || isAtRight)
     {
-        QVector<ParenthesisInfo *> infos = data->parentheses();
+        const TextBlockData::ParenthesisList &infos = data->parentheses();
         for (int i = 0; i < infos.size(); ++i)
         {
-            ParenthesisInfo *info = infos.at (i);
+            const ParenthesisInfo &info = infos.at (i);
 
-            if (isAtLeft && info->position == curBlockPos && info->character == '(')
+            if (isAtLeft && info.position == curBlockPos && info.character == '(')
             {
                 if (matchLeftParenthesis (cur.block(), i + 1, 0))
                 {
-                    createSelection (blockPos + info->position);
+                    createSelection (blockPos + info.position);
                     if (isAtRight) isAtLeft = false;
                     else break;
                 }
             }
-            if (isAtRight && info->position == curBlockPos - 1 && info->character == ')')
+            if (isAtRight && info.position == curBlockPos - 1 && info.character == ')')
             {
                 if (matchRightParenthesis (cur.block(), infos.size() - i, 0))
                 {
-                    createSelection (blockPos + info->position);
+                    createSelection (blockPos + info.position);
                     if (isAtLeft) isAtRight = false;
                     else break;
                 }
@@ -88,25 +90,25 @@ void FPwin::matchBrackets()
     findNextBrace = !isAtLeft || !isAtRight;
     if (isAtLeft || isAtRight)
     {
-        QVector<BraceInfo *> braceInfos = data->braces();
+        const TextBlockData::BraceList &braceInfos = data->braces();
         for (int i = 0; i < braceInfos.size(); ++i)
         {
-            BraceInfo *info = braceInfos.at (i);
+            const BraceInfo &info = braceInfos.at (i);
 
-            if (isAtLeft && info->position == curBlockPos && info->character == '{')
+            if (isAtLeft && info.position == curBlockPos && info.character == '{')
             {
                 if (matchLeftBrace (cur.block(), i + 1, 0))
                 {
-                    createSelection (blockPos + info->position);
+                    createSelection (blockPos + info.position);
                     if (isAtRight) isAtLeft = false;
                     else break;
                 }
             }
-            if (isAtRight && info->position == curBlockPos - 1 && info->character == '}')
+            if (isAtRight && info.position == curBlockPos - 1 && info.character == '}')
             {
                 if (matchRightBrace (cur.block(), braceInfos.size() - i, 0))
                 {
-                    createSelection (blockPos + info->position);
+                    createSelection (blockPos + info.position);
                     if (isAtLeft) isAtRight = false;
                     else break;
                 }
@@ -120,25 +122,25 @@ void FPwin::matchBrackets()
     isAtRight = (doc->characterAt (curPos - 1) == ']');
     if (isAtLeft || isAtRight)
     {
-        QVector<BracketInfo *> bracketInfos = data->brackets();
+        const TextBlockData::BracketList &bracketInfos = data->brackets();
         for (int i = 0; i < bracketInfos.size(); ++i)
         {
-            BracketInfo *info = bracketInfos.at (i);
+            const BracketInfo &info = bracketInfos.at (i);
 
-            if (isAtLeft && info->position == curBlockPos && info->character == '[')
+            if (isAtLeft && info.position == curBlockPos && info.character == '[')
             {
                 if (matchLeftBracket (cur.block(), i + 1, 0))
                 {
-                    createSelection (blockPos + info->position);
+                    createSelection (blockPos + info.position);
                     if (isAtRight) isAtLeft = false;
                     else break;
                 }
             }
-            if (isAtRight && info->position == curBlockPos - 1 && info->character == ']')
+            if (isAtRight && info.position == curBlockPos - 1 && info.character == ']')
             {
                 if (matchRightBracket (cur.block(), bracketInfos.size() - i, 0))
                 {
-                    createSelection (blockPos + info->position);
+                    createSelection (blockPos + info.position);
                     if (isAtLeft) isAtRight = false;
                     else break;
                 }
@@ -151,28 +153,28 @@ bool FPwin::matchLeftParenthesis (QTextBlock currentBlock, int i, int numLeftPar
 {
     TextBlockData *data = static_cast<TextBlockData *>(currentBlock.userData());
     if (!data) return false;
-    QVector<ParenthesisInfo *> infos = data->parentheses();
+    const TextBlockData::ParenthesisList &infos = data->parentheses();
 
     int docPos = currentBlock.position();
     for (; i < infos.size(); ++i)
     {
-        ParenthesisInfo *info = infos.at (i);
-        if (info->character == '(')
+        const ParenthesisInfo &info = infos.at (i);
+        if (info.character == '(')
         {
             ++numLeftParentheses;
             continue;
         }
 
-        if (info->character == ')' && numLeftParentheses == 0)
+        if (info.character == ')' && numLeftParentheses == 0)
         {
-            createSelection (docPos + info->position);
+            createSelection (docPos + info.position);
             return true;
         }
         else
             --numLeftParentheses;
     }
 
-    currentBlock = currentBlock.next();
+    currentBlock = matchingBlock (currentBlock, BracketIndex::Parenthesis, numLeftParentheses, true);
     if (currentBlock.isValid())
         return matchLeftParenthesis (currentBlock, 0, numLeftParentheses);
 
@@ -183,27 +185,27 @@ bool FPwin::matchRightParenthesis (QTextBlock currentBlock, int i, int numRightP
 {
     TextBlockData *data = static_cast<TextBlockData *>(currentBlock.userData());
     if (!data) return false;
-    QVector<ParenthesisInfo *> infos = data->parentheses();
+    const TextBlockData::ParenthesisList &infos = data->parentheses();
 
     int docPos = currentBlock.position();
     for (; i < infos.size(); ++i)
     {
-        ParenthesisInfo *info = infos.at (infos.size() - 1 - i);
-        if (info->character == ')')
+        const ParenthesisInfo &info = infos.at (infos.size() - 1 - i);
+        if (info.character == ')')
         {
             ++numRightParentheses;
             continue;
         }
-        if (info->character == '(' && numRightParentheses == 0)
+        if (info.character == '(' && numRightParentheses == 0)
         {
-            createSelection (docPos + info->position);
+            createSelection (docPos + info.position);
             return true;
         }
         else
             --numRightParentheses;
     }
 
-    currentBlock = currentBlock.previous();
+    currentBlock = matchingBlock (currentBlock, BracketIndex::Parenthesis, numRightParentheses, false);
     if (currentBlock.isValid())
         return matchRightParenthesis (currentBlock, 0, numRightParentheses);
 
@@ -214,28 +216,28 @@ bool FPwin::matchLeftBrace (QTextBlock currentBlock, int i, int numRightBraces)
 {
     TextBlockData *data = static_cast<TextBlockData *>(currentBlock.userData());
     if (!data) return false;
-    QVector<BraceInfo *> infos = data->braces();
+    const TextBlockData::BraceList &infos = data->braces();
 
     int docPos = currentBlock.position();
     for (; i < infos.size(); ++i)
     {
-        BraceInfo *info = infos.at (i);
-        if (info->character == '{')
+        const BraceInfo &info = infos.at (i);
+        if (info.character == '{')
         {
             ++numRightBraces;
             continue;
         }
 
-        if (info->character == '}' && numRightBraces == 0)
+        if (info.character == '}' && numRightBraces == 0)
         {
-            createSelection (docPos + info->position);
+            createSelection (docPos + info.position);
             return true;
         }
         else
             --numRightBraces;
     }
 
-    currentBlock = currentBlock.next();
+    currentBlock = matchingBlock (currentBlock, BracketIndex::Brace, numRightBraces, true);
     if (currentBlock.isValid())
         return matchLeftBrace (currentBlock, 0, numRightBraces);
 
@@ -246,27 +248,27 @@ bool FPwin::matchRightBrace (QTextBlock currentBlock, int i, int numLeftBraces)
 {
     TextBlockData *data = static_cast<TextBlockData *>(currentBlock.userData());
     if (!data) return false;
-    QVector<BraceInfo *> infos = data->braces();
+    const TextBlockData::BraceList &infos = data->braces();
 
     int docPos = currentBlock.position();
     for (; i < infos.size(); ++i)
     {
-        BraceInfo *info = infos.at (infos.size() - 1 - i);
-        if (info->character == '}')
+        const BraceInfo &info = infos.at (infos.size() - 1 - i);
+        if (info.character == '}')
         {
             ++numLeftBraces;
             continue;
         }
-        if (info->character == '{' && numLeftBraces == 0)
+        if (info.character == '{' && numLeftBraces == 0)
         {
-            createSelection (docPos + info->position);
+            createSelection (docPos + info.position);
             return true;
         }
         else
             --numLeftBraces;
     }
 
-    currentBlock = currentBlock.previous();
+    currentBlock = matchingBlock (currentBlock, BracketIndex::Brace, numLeftBraces, false);
     if (currentBlock.isValid())
         return matchRightBrace (currentBlock, 0, numLeftBraces);
 
@@ -277,28 +279,28 @@ bool FPwin::matchLeftBracket (QTextBlock currentBlock, int i, int numRightBracke
 {
     TextBlockData *data = static_cast<TextBlockData *>(currentBlock.userData());
     if (!data) return false;
-    QVector<BracketInfo *> infos = data->brackets();
+    const TextBlockData::BracketList &infos = data->brackets();
 
     int docPos = currentBlock.position();
     for (; i < infos.size(); ++i)
     {
-        BracketInfo *info = infos.at (i);
-        if (info->character == '[')
+        const BracketInfo &info = infos.at (i);
+        if (info.character == '[')
         {
             ++numRightBrackets;
             continue;
         }
 
-        if (info->character == ']' && numRightBrackets == 0)
+        if (info.character == ']' && numRightBrackets == 0)
         {
-            createSelection (docPos + info->position);
+            createSelection (docPos + info.position);
             return true;
         }
         else
             --numRightBrackets;
     }
 
-    currentBlock = currentBlock.next();
+    currentBlock = matchingBlock (currentBlock, BracketIndex::Bracket, numRightBrackets, true);
     if (currentBlock.isValid())
         return matchLeftBracket (currentBlock, 0, numRightBrackets);
 
@@ -309,33 +311,60 @@ bool FPwin::matchRightBracket (QTextBlock currentBlock, int i, int numLeftBracke
 {
     TextBlockData *data = static_cast<TextBlockData *>(currentBlock.userData());
     if (!data) return false;
-    QVector<BracketInfo *> infos = data->brackets();
+    const TextBlockData::BracketList &infos = data->brackets();
 
     int docPos = currentBlock.position();
     for (; i < infos.size(); ++i)
     {
-        BracketInfo *info = infos.at (infos.size() - 1 - i);
-        if (info->character == ']')
+        const BracketInfo &info = infos.at (infos.size() - 1 - i);
+        if (info.character == ']')
         {
             ++numLeftBrackets;
             continue;
         }
-        if (info->character == '[' && numLeftBrackets == 0)
+        if (info.character == '[' && numLeftBrackets == 0)
         {
-            createSelection (docPos + info->position);
+            createSelection (docPos + info.position);
             return true;
         }
         else
             --numLeftBrackets;
     }
 
-    currentBlock = currentBlock.previous();
+    currentBlock = matchingBlock (currentBlock, BracketIndex::Bracket, numLeftBrackets, false);
     if (currentBlock.isValid())
         return matchRightBracket (currentBlock, 0, numLeftBrackets);
 
     return false;
 }
 /*************************/
+// Finds the next (or previous) block that may contain the match by using the bracket
+// index of the highlighter or scanner, so that blocks without brackets are skipped.
+// "depth" is the number of unmatched brackets and is updated for the found block.
+QTextBlock FPwin::matchingBlock (const QTextBlock &block, BracketIndex::Kind kind,
+                                 int &depth, bool forward)
+{
+    int index = ui->tabWidget->currentIndex();
+    if (index == -1) return QTextBlock();
+    TextEdit *textEdit = qobject_cast< TabPage *>(ui->tabWidget->widget (index))->textEdit();
+    const BracketIndex *bracketIndex = textEdit->getBracketIndex();
+    if (bracketIndex == nullptr)
+    { // check blocks one by one
+        return (forward ? block.next() : block.previous());
+    }
+
+    int n = forward ? bracketIndex->forwardMatch (block.blockNumber(), kind, depth)
+                    : bracketIndex->backwardMatch (block.blockNumber(), kind, depth);
+    if (n < 0) return QTextBlock();
+    QTextBlock found = textEdit->document()->findBlockByNumber (n);
+    if (!found.userData())
+    { // the data of a far block may have been removed in the lazy mode
+        if (Highlighter *highlighter = qobject_cast< Highlighter *>(textEdit->getHighlighter()))
+            highlighter->restoreData (found);
+    }
+    return found;
+}
+/*************************/
 void FPwin::createSelection (int pos)
 {
     int index = ui->tabWidget->currentIndex();
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "bracketscanner.h"
+#include "highlighter.h"
+#include <QTextDocument>
+#include <QElapsedTimer>
+
+#define SCAN_SLICE 10 // in ms
+
+namespace FeatherPad {
+
+BracketScanner::BracketScanner (QTextDocument *document, QObject *parent) : QObject (parent)
+{
+    doc_ = document;
+    dirtyFrom_ = dirtyTo_ = -1;
+    active_ = false;
+    quotes_ = multiLineQuotes_ = false;
+
+    timer_ = new QTimer (this);
+    timer_->setSingleShot (true);
+    connect (timer_, &QTimer::timeout, this, &BracketScanner::scan);
+}
+/*************************/
+void BracketScanner::setActive (bool active)
+{
+    if (active_ == active) return;
+    active_ = active;
+    if (active_)
+    {
+        connect (doc_, &QTextDocument::contentsChange, this, &BracketScanner::onContentsChange);
+        restart();
+    }
+    else
+    {
+        disconnect (doc_, &QTextDocument::contentsChange, this, &BracketScanner::onContentsChange);
+        timer_->stop();
+        dirtyFrom_ = dirtyTo_ = -1;
+        index_.clear();
+        states_.clear();
+    }
+}
+/*************************/
+void BracketScanner::setLanguage (const QString &lang)
+{
+    if (lang == lang_) return;
+    lang_ = lang;
+
+    lineComment_.clear();
+    commentStart_.clear();
+    commentEnd_.clear();
+    quotes_ = multiLineQuotes_ = false;
+
+    if (lang == "c" || lang == "cpp" || lang == "javascript"
+        || lang == "qml" || lang == "php")
+    {
+        lineComment_ = "//";
+        commentStart_ = "/*";
+        commentEnd_ = "*/";
+        quotes_ = true;
+    }
+    else if (lang == "css")
+    {
+        commentStart_ = "/*";
+        commentEnd_ = "*/";
+        quotes_ = true;
+    }
+    else if (lang == "sh" || lang == "perl" || lang == "ruby")
+    {
+        lineComment_ = "#";
+        quotes_ = multiLineQuotes_ = true;
+    }
+    else if (lang == "python" || lang == "cmake" || lang == "makefile"
+             || lang == "qmake")
+    {
+        lineComment_ = "#";
+        quotes_ = true;
+    }
+    else if (lang == "lua")
+    {
+        lineComment_ = "--";
+        commentStart_ = "--[[";
+        commentEnd_ = "]]";
+        quotes_ = true;
+    }
+    /* otherwise, all brackets are considered */
+
+    if (active_)
+        restart();
+}
+/*************************/
+void BracketScanner::restart()
+{
+    int count = doc_->blockCount();
+    index_.reset (count);
+    states_.fill (normalState, count);
+    dirtyFrom_ = 0;
+    dirtyTo_ = count - 1;
+    timer_->start (0);
+}
+/*************************/
+void BracketScanner::onContentsChange (int pos, int charsRemoved, int charsAdded)
+{
+    if (charsRemoved == 0 && charsAdded == 0) return; // only formats are changed
+
+    int bn = doc_->findBlock (pos).blockNumber();
+    if (bn < 0) return;
+    int count = doc_->blockCount();
+    int delta = count - index_.size();
+    if (delta > 0)
+    {
+        index_.insertBlocks (bn + 1, delta);
+        states_.insert (qMin (bn + 1, states_.size()), delta, normalState);
+    }
+    else if (delta < 0)
+    {
+        index_.removeBlocks (bn + 1, -delta);
+        if (bn + 1 < states_.size())
+            states_.remove (bn + 1, qMin (-delta, states_.size() - bn - 1));
+    }
+    if (states_.size() != count || index_.size() != count)
+    { // just a precaution
+        restart();
+        return;
+    }
+
+    /* shift the remaining range of a previous change */
+    if (dirtyFrom_ > bn)
+        dirtyFrom_ = qMax (bn, dirtyFrom_ + delta);
+    if (dirtyTo_ > bn)
+        dirtyTo_ = qMax (bn, dirtyTo_ + delta);
+
+    int last = qMax (bn, doc_->findBlock (pos + charsAdded).blockNumber());
+    dirtyFrom_ = dirtyFrom_ < 0 ? bn : qMin (dirtyFrom_, bn);
+    dirtyTo_ = qMax (dirtyTo_, last);
+
+    /* the changed blocks are scanned immediately because
+       bracket matching is done just after the cursor moves */
+    timer_->stop();
+    scan();
+}
+/*************************/
+void BracketScanner::scan()
+{
+    if (!active_ || dirtyFrom_ < 0) return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int n = dirtyFrom_;
+    QTextBlock block = doc_->findBlockByNumber (n);
+    int state = n > 0 ? states_.at (n - 1) : normalState;
+    while (block.isValid() && n < states_.size())
+    {
+        state = scanBlock (block, n, state);
+        bool changed (states_.at (n) != state);
+        states_[n] = state;
+        if (n >= dirtyTo_ && !changed)
+            break; // the next blocks are unchanged
+        block = block.next();
+        ++n;
+        if (block.isValid() && timer.elapsed() > SCAN_SLICE)
+        { // continue later
+            dirtyFrom_ = n;
+            if (dirtyTo_ < n) dirtyTo_ = n;
+            timer_->start (0);
+            return;
+        }
+    }
+    dirtyFrom_ = dirtyTo_ = -1;
+}
+/*************************/
+// Puts the brackets of the block into its data and the index, skipping strings
+// and comments, and returns the scan state at the end of the block.
+int BracketScanner::scanBlock (QTextBlock &block, int blockNumber, int state)
+{
+    TextBlockData *data = static_cast<TextBlockData *>(block.userData());
+    if (data)
+        data->reset();
+
+    const QString text = block.text();
+    const int l = text.length();
+    bool hasBrackets (false);
+    int i = 0;
+    while (i < l)
+    {
+        if (state == commentState)
+        {
+            int end = text.indexOf (commentEnd_, i);
+            if (end == -1) break;
+            i = end + commentEnd_.length();
+            state = normalState;
+            continue;
+        }
+        if (state == doubleQuoteState || state == singleQuoteState)
+        {
+            const QChar q = state == doubleQuoteState ? '\"' : '\'';
+            while (i < l && text.at (i) != q)
+            {
+                if (text.at (i) == '\\')
+                    ++i;
+                ++i;
+            }
+            if (i >= l) break;
+            ++i;
+            state = normalState;
+            continue;
+        }
+
+        const QChar c = text.at (i);
+        if (!commentStart_.isEmpty() && text.midRef (i, commentStart_.length()) == commentStart_)
+        {
+            i += commentStart_.length();
+            state = commentState;
+            continue;
+        }
+        if (!lineComment_.isEmpty() && text.midRef (i, lineComment_.length()) == lineComment_
+            /* in sh, "#" starts a comment only at the start of a word */
+            && (lang_ != "sh" || i == 0 || text.at (i - 1).isSpace()))
+        {
+            break;
+        }
+        if (quotes_ && (c == '\"' || c == '\''))
+        {
+            state = c == '\"' ? doubleQuoteState : singleQuoteState;
+            ++i;
+            continue;
+        }
+
+        if (c == '(' || c == ')' || c == '{' || c == '}' || c == '[' || c == ']')
+        {
+            if (!data)
+            {
+                data = new TextBlockData;
+                block.setUserData (data);
+            }
+            char ch = c.toLatin1();
+            if (c == '(' || c == ')')
+            {
+                ParenthesisInfo info = {ch, i};
+                data->insertInfo (info);
+            }
+            else if (c == '{' || c == '}')
+            {
+                BraceInfo info = {ch, i};
+                data->insertInfo (info);
+            }
+            else
+            {
+                BracketInfo info = {ch, i};
+                data->insertInfo (info);
+            }
+            hasBrackets = true;
+        }
+        ++i;
+    }
+
+    if (!multiLineQuotes_ && (state == doubleQuoteState || state == singleQuoteState))
+        state = normalState;
+
+    if (hasBrackets)
+        index_.setBlock (blockNumber, data);
+    else
+        index_.clearBlock (blockNumber);
+
+    return state;
+}
+
+}
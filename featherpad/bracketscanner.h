@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef BRACKETSCANNER_H
+#define BRACKETSCANNER_H
+
+#include <QObject>
+#include <QTextBlock>
+#include <QTimer>
+#include <QVector>
+#include "bracketindex.h"
+
+namespace FeatherPad {
+
+/* When there's no syntax highlighter, this object records the brackets of
+   blocks in their TextBlockData, as the highlighter does, so that brackets
+   can be matched in all documents. It skips strings and comments if the
+   language is known and scans the document in time slices, starting from
+   the changed blocks and stopping where nothing has changed. */
+class BracketScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    BracketScanner (QTextDocument *document, QObject *parent = nullptr);
+
+    bool isActive() const {
+        return active_;
+    }
+    /* the scanner should be inactive while a highlighter exists */
+    void setActive (bool active);
+    void setLanguage (const QString &lang);
+
+    const BracketIndex &getBracketIndex() const {
+        return index_;
+    }
+
+private slots:
+    void onContentsChange (int pos, int charsRemoved, int charsAdded);
+    void scan();
+
+private:
+    void restart();
+    int scanBlock (QTextBlock &block, int blockNumber, int state);
+
+    enum ScanState
+    {
+        normalState = 0,
+        commentState,
+        doubleQuoteState,
+        singleQuoteState
+    };
+
+    QTextDocument *doc_;
+    QTimer *timer_;
+    BracketIndex index_;
+    QVector<char> states_; // the scan states at the ends of blocks
+    int dirtyFrom_; // the first block to be scanned (-1 if none)
+    int dirtyTo_; // scanning may stop after this block if a state doesn't change
+    bool active_;
+    /* language-dependent info */
+    QString lang_;
+    QString lineComment_, commentStart_, commentEnd_;
+    bool quotes_; // skip quotes?
+    bool multiLineQuotes_; // can quotes span multiple lines?
+};
+
+}
+
+#endif // BRACKETSCANNER_H
@@ -664,5 +664,29 @@ const QString detectCharset (const QByteArray byteArray)
 
     return QString::fromStdString (charset);
 }
+/*************************/
+const QString detectUnicodeCharset (const unsigned char *C, int num)
+{
+    if (num == 2 && ((C[0] != '\0' && C[1] == '\0') || (C[0] == '\0' && C[1] != '\0')))
+        return "UTF-16"; // single character
+    if (num == 4)
+    {
+        if ((C[0] == 0xFF && C[1] == 0xFE && C[2] != '\0' && C[3] == '\0') // le
+            || (C[0] == 0xFE && C[1] == 0xFF && C[2] == '\0' && C[3] != '\0') // be
+            || (C[0] != '\0' && C[1] == '\0' && C[2] != '\0' && C[3] == '\0') // le
+            || (C[0] == '\0' && C[1] != '\0' && C[2] == '\0' && C[3] != '\0')) // be
+        {
+            return "UTF-16";
+        }
+        /*if ((C[0] == 0xFF && C[1] == 0xFE && C[2] == '\0' && C[3] == '\0')
+              || (C[0] == '\0' && C[1] == '\0' && C[2] == 0xFE && C[3] == 0xFF))*/
+        if ((C[0] != '\0' && C[1] != '\0' && C[2] == '\0' && C[3] == '\0') // le
+            || (C[0] == '\0' && C[1] == '\0' && C[2] != '\0' && C[3] != '\0')) // be
+        {
+            return "UTF-32";
+        }
+    }
+    return QString();
+}
 
 }
@@ -6,6 +6,8 @@
 namespace FeatherPad {
 
 const QString detectCharset (const QByteArray byteArray);
+/* returns "UTF-16" or "UTF-32" if the first "num" bytes of a file (at most 4) show it */
+const QString detectUnicodeCharset (const unsigned char *C, int num);
 
 }
 
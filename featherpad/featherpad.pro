@@ -29,7 +29,16 @@ SOURCES += main.cpp \
            highlighter-html.cpp \
            highlighter-patterns.cpp \
            highlighter-jsregex.cpp \
+           bracketindex.cpp \
+           bracketscanner.cpp \
+           textsearch.cpp \
+           searchindex.cpp \
+           replacing.cpp \
+           searching.cpp \
+           grepping.cpp \
+           searchresults.cpp \
            vscrollbar.cpp \
+           framestats.cpp \
            loading.cpp \
            tabpage.cpp \
            searchbar.cpp \
@@ -42,10 +51,20 @@ HEADERS += singleton.h \
            tabwidget.h \
            lineedit.h \
            textedit.h \
+           blockcache.h \
            tabbar.h \
            x11.h \
            highlighter.h \
+           bracketindex.h \
+           bracketscanner.h \
+           textsearch.h \
+           searchindex.h \
+           replacing.h \
+           searching.h \
+           grepping.h \
+           searchresults.h \
            vscrollbar.h \
+           framestats.h \
            filedialog.h \
            config.h \
            pref.h \
@@ -26,6 +26,8 @@
 #include "session.h"
 #include "loading.h"
 #include "warningbar.h"
+#include "searchindex.h"
+#include "textsearch.h"
 
 #include <QFontDialog>
 #include <QPrintDialog>
@@ -61,11 +63,15 @@ FPwin::FPwin (QWidget *parent):QMainWindow (parent), dummyWidget (nullptr), ui (
     loadingProcesses_ = 0;
     rightClicked_ = -1;
     busyThread_ = nullptr;
+    replacingThread_ = nullptr;
 
     autoSaver_ = nullptr;
     autoSaverRemainingTime_ = -1;
 
     sidePane_ = nullptr;
+    resultsDock_ = nullptr;
+    searchResults_ = nullptr;
+    textSearch_ = nullptr;
 
     /* JumpTo bar*/
     ui->spinBox->hide();
@@ -204,6 +210,8 @@ FPwin::FPwin (QWidget *parent):QMainWindow (parent), dummyWidget (nullptr), ui (
 
     connect (ui->actionFind, &QAction::triggered, this, &FPwin::showHideSearch);
     connect (ui->actionJump, &QAction::triggered, this, &FPwin::jumpTo);
+    connect (ui->actionFindAll, &QAction::triggered, this, &FPwin::findInAllTabs);
+    connect (ui->actionFindInFolder, &QAction::triggered, this, &FPwin::findInFolder);
     connect (ui->spinBox, &QAbstractSpinBox::editingFinished, this, &FPwin::goTo);
 
     connect (ui->actionLineNumbers, &QAction::toggled, this, &FPwin::showLN);
@@ -278,6 +286,12 @@ FPwin::FPwin (QWidget *parent):QMainWindow (parent), dummyWidget (nullptr), ui (
 FPwin::~FPwin()
 {
     startAutoSaving (false);
+    if (replacingThread_ && replacingThread_->isRunning())
+    {
+        replacingThread_->requestInterruption();
+        replacingThread_->wait();
+    }
+    delete textSearch_; textSearch_ = nullptr;
     delete dummyWidget; dummyWidget = nullptr;
     delete aGroup_; aGroup_ = nullptr;
     delete ui; ui = nullptr;
@@ -630,7 +644,7 @@ void FPwin::applyConfigOnStarting()
                  << tr ("Ctrl+Alt+E")
                  << tr ("Shift+Enter") << tr ("Ctrl+Tab") << tr ("Ctrl+Meta+Tab")
                  << tr ("Alt+Right") << tr ("Alt+Left") << tr ("Alt+Down")  << tr ("Alt+Up")
-                 << tr ("Ctrl+Shift+J")
+                 << tr ("Ctrl+Shift+J") << tr ("Ctrl+Shift+F")
                  << tr ("Ctrl+K"); // used by LineEdit
         config.setReservedShortcuts (reserved);
         config.readShortcuts();
@@ -1015,6 +1029,8 @@ void FPwin::enableWidgets (bool enable) const
 
     ui->actionSelectAll->setEnabled (enable);
     ui->actionFind->setEnabled (enable);
+    ui->actionFindAll->setEnabled (enable);
+    ui->actionFindInFolder->setEnabled (enable);
     ui->actionJump->setEnabled (enable);
     ui->actionReplace->setEnabled (enable);
     ui->actionClose->setEnabled (enable);
@@ -1133,6 +1149,8 @@ void FPwin::updateShortcuts (bool disable, bool page)
         ui->actionLeftTab->setShortcut (QKeySequence());
         ui->actionLastTab->setShortcut (QKeySequence());
         ui->actionFirstTab->setShortcut (QKeySequence());
+
+        ui->actionFindAll->setShortcut (QKeySequence());
     }
     else
     {
@@ -1159,6 +1177,8 @@ void FPwin::updateShortcuts (bool disable, bool page)
         }
         ui->actionLastTab->setShortcut (QKeySequence (tr ("Alt+Up")));
         ui->actionFirstTab->setShortcut (QKeySequence (tr ("Alt+Down")));
+
+        ui->actionFindAll->setShortcut (QKeySequence (tr ("Ctrl+Shift+F")));
     }
     updateCustomizableShortcuts (disable);
 
@@ -1245,6 +1265,7 @@ TabPage* FPwin::createEmptyTab (bool setCurrent)
     connect (textEdit, &QPlainTextEdit::copyAvailable, ui->actionCopy, &QAction::setEnabled);
     connect (textEdit, &TextEdit::fileDropped, this, &FPwin::newTabFromName);
     connect (textEdit, &TextEdit::zoomedOut, this, &FPwin::reformat);
+    connect (textEdit, &TextEdit::updateBracketMatching, this, &FPwin::matchBrackets);
 
     connect (tabPage, &TabPage::find, this, &FPwin::find);
     connect (tabPage, &TabPage::searchFlagChanged, this, &FPwin::searchFlagChanged);
@@ -2915,6 +2936,7 @@ void FPwin::showHideSearch()
             /* ... remove all yellow and green highlights... */
             TextEdit *textEdit = page->textEdit();
             textEdit->setSearchedText (QString());
+            textEdit->getSearchIndex()->clear();
             QList<QTextEdit::ExtraSelection> es;
             textEdit->setGreenSel (es); // not needed
             if (ui->actionLineNumbers->isChecked() || ui->spinBox->isVisible())
@@ -2928,6 +2950,193 @@ void FPwin::showHideSearch()
     }
 }
 /*************************/
+// Finds the text of the search bar in all tabs of all windows,
+// with the search options of the current tab.
+void FPwin::findInAllTabs()
+{
+    if (!isReady()) return;
+
+    TabPage *tabPage = qobject_cast< TabPage *>(ui->tabWidget->currentWidget());
+    if (tabPage == nullptr) return;
+
+    QString txt = tabPage->searchEntry();
+    if (txt.isEmpty())
+    { // the search text should be entered first
+        if (!tabPage->isSearchBarVisible() || !tabPage->searchBarHasFocus())
+            showHideSearch();
+        return;
+    }
+
+    showResultsDock();
+
+    QList<TabPage*> pages;
+    FPsingleton *singleton = static_cast<FPsingleton*>(qApp);
+    for (int i = 0; i < singleton->Wins.count(); ++i)
+    {
+        FPwin *win = singleton->Wins.at (i);
+        for (int j = 0; j < win->ui->tabWidget->count(); ++j)
+            pages.append (qobject_cast< TabPage *>(win->ui->tabWidget->widget (j)));
+    }
+    searchResults_->searchTabs (pages, txt,
+                                tabPage->matchCase() ? Qt::CaseSensitive : Qt::CaseInsensitive,
+                                tabPage->matchWhole(), tabPage->matchRegex());
+}
+/*************************/
+// Finds the text of the search bar in the text files of a folder and its subfolders.
+void FPwin::findInFolder()
+{
+    if (!isReady()) return;
+
+    TabPage *tabPage = qobject_cast< TabPage *>(ui->tabWidget->currentWidget());
+    if (tabPage == nullptr) return;
+
+    QString txt = tabPage->searchEntry();
+    if (txt.isEmpty())
+    { // the search text should be entered first
+        if (!tabPage->isSearchBarVisible() || !tabPage->searchBarHasFocus())
+            showHideSearch();
+        return;
+    }
+
+    /* start from the folder of the current file */
+    QString path;
+    QString fname = tabPage->textEdit()->getFileName();
+    if (!fname.isEmpty())
+        path = QFileInfo (fname).absolutePath();
+    if (path.isEmpty() || !QFileInfo (path).isDir())
+        path = QDir::home().path();
+
+    if (hasAnotherDialog()) return;
+    updateShortcuts (true);
+    FileDialog dialog (this, static_cast<FPsingleton*>(qApp)->getConfig().getNativeDialog());
+    dialog.setAcceptMode (QFileDialog::AcceptOpen);
+    dialog.setWindowTitle (tr ("Find in folder..."));
+    dialog.setFileMode (QFileDialog::Directory);
+    dialog.setOption (QFileDialog::ShowDirsOnly);
+    dialog.setDirectory (path);
+    QString dir;
+    if (dialog.exec() && !dialog.selectedFiles().isEmpty())
+        dir = dialog.selectedFiles().at (0);
+    updateShortcuts (false);
+    if (dir.isEmpty()) return;
+
+    showResultsDock();
+    searchResults_->searchFolder (dir, txt,
+                                  tabPage->matchCase() ? Qt::CaseSensitive : Qt::CaseInsensitive,
+                                  tabPage->matchWhole(), tabPage->matchRegex());
+}
+/*************************/
+void FPwin::showResultsDock()
+{
+    if (resultsDock_ == nullptr)
+    {
+        searchResults_ = new SearchResults();
+        resultsDock_ = new QDockWidget (tr ("Search Results"), this);
+        resultsDock_->setObjectName ("resultsDock");
+        resultsDock_->setWidget (searchResults_);
+        addDockWidget (Qt::BottomDockWidgetArea, resultsDock_);
+        connect (searchResults_, &SearchResults::tabResultActivated, this, &FPwin::showSearchResult);
+        connect (searchResults_, &SearchResults::fileResultActivated, this, &FPwin::showFileResult);
+    }
+    resultsDock_->setVisible (true);
+    resultsDock_->raise();
+}
+/*************************/
+// Activates the tab of a search result, in whatever window it is, and selects the match.
+// The document may have changed after the search; then only the line is found.
+void FPwin::showSearchResult (TabPage *tabPage, int line, int column, int length)
+{
+    FPsingleton *singleton = static_cast<FPsingleton*>(qApp);
+    for (int i = 0; i < singleton->Wins.count(); ++i)
+    {
+        FPwin *win = singleton->Wins.at (i);
+        int index = win->ui->tabWidget->indexOf (tabPage);
+        if (index == -1) continue;
+        if (!win->isReady()) return;
+
+        if (win->sidePane_ && !win->sideItems_.isEmpty())
+            win->sidePane_->listWidget()->setCurrentItem (win->sideItems_.key (tabPage)); // sets the current widget at changeTab()
+        else
+            win->ui->tabWidget->setCurrentIndex (index);
+
+        TextEdit *textEdit = tabPage->textEdit();
+        QTextDocument *doc = textEdit->document();
+        QTextBlock block = doc->findBlockByNumber (line);
+        if (!block.isValid())
+            block = doc->lastBlock();
+        QTextCursor cursor = textEdit->textCursor();
+        if (column < block.length())
+        {
+            cursor.setPosition (block.position() + column);
+            cursor.setPosition (qMin (block.position() + column + length, doc->characterCount() - 1),
+                                QTextCursor::KeepAnchor);
+        }
+        else
+            cursor.setPosition (block.position());
+        textEdit->setTextCursor (cursor);
+        textEdit->setFocus();
+
+        if (win != this)
+        {
+            if (singleton->isX11() && isWindowShaded (win->winId()))
+                unshadeWindow (win->winId());
+            win->activateWindow();
+            win->raise();
+        }
+        return;
+    }
+}
+/*************************/
+// Shows a match of a folder search in the tab of its file,
+// after opening the file in this window if it isn't open.
+// Paths are compared after resolving symlinks and "..", so that a file
+// of a folder search is recognized in any tab that has it open.
+static bool isSameFile (const QString &fileName, const QString &canonicalPath)
+{
+    if (fileName.isEmpty()) return false;
+    const QString path = QFileInfo (fileName).canonicalFilePath();
+    return path.isEmpty() ? false : path == canonicalPath;
+}
+/*************************/
+void FPwin::showFileResult (const QString &fileName, int line, int column, int length)
+{
+    QString canonicalPath = QFileInfo (fileName).canonicalFilePath();
+    if (canonicalPath.isEmpty()) // the file is removed
+        canonicalPath = fileName;
+    FPsingleton *singleton = static_cast<FPsingleton*>(qApp);
+    for (int i = 0; i < singleton->Wins.count(); ++i)
+    {
+        FPwin *win = singleton->Wins.at (i);
+        for (int j = 0; j < win->ui->tabWidget->count(); ++j)
+        {
+            TabPage *tabPage = qobject_cast< TabPage *>(win->ui->tabWidget->widget (j));
+            const QString tabFile = tabPage->textEdit()->getFileName();
+            if (tabFile == fileName || isSameFile (tabFile, canonicalPath))
+            {
+                showSearchResult (tabPage, line, column, length);
+                return;
+            }
+        }
+    }
+
+    if (!isReady()) return;
+    disconnect (resultConnection_);
+    resultConnection_ = connect (this, &FPwin::finishedLoading, this, [=] {
+        disconnect (resultConnection_);
+        for (int j = 0; j < ui->tabWidget->count(); ++j)
+        {
+            TabPage *tabPage = qobject_cast< TabPage *>(ui->tabWidget->widget (j));
+            const QString tabFile = tabPage->textEdit()->getFileName();
+            if (tabFile == fileName || isSameFile (tabFile, canonicalPath))
+            {
+                showSearchResult (tabPage, line, column, length);
+                return;
+            }
+        }
+    });
+    newTabFromName (fileName, false);
+}
+/*************************/
 void FPwin::jumpTo()
 {
     if (!isReady()) return;
@@ -3591,6 +3800,7 @@ void FPwin::detachTab()
     }
     connect (textEdit, &TextEdit::fileDropped, dropTarget, &FPwin::newTabFromName);
     connect (textEdit, &TextEdit::zoomedOut, dropTarget, &FPwin::reformat);
+    connect (textEdit, &TextEdit::updateBracketMatching, dropTarget, &FPwin::matchBrackets);
 
     textEdit->setFocus();
 
@@ -3813,6 +4023,7 @@ void FPwin::dropTab (QString str)
     }
     connect (textEdit, &TextEdit::fileDropped, this, &FPwin::newTabFromName);
     connect (textEdit, &TextEdit::zoomedOut, this, &FPwin::reformat);
+    connect (textEdit, &TextEdit::updateBracketMatching, this, &FPwin::matchBrackets);
 
     textEdit->setFocus();
 
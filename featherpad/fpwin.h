@@ -22,17 +22,20 @@
 
 #include <QMainWindow>
 #include <QActionGroup>
+#include <QDockWidget>
 #include <QElapsedTimer>
 #include "highlighter.h"
 #include "textedit.h"
 #include "tabpage.h"
 #include "sidepane.h"
+#include "searchresults.h"
 #include "config.h"
 
 namespace FeatherPad {
 
 namespace Ui {
 class FPwin;
+class TextSearch;
 }
 
 class BusyMaker : public QObject {
@@ -129,6 +132,10 @@ private slots:
     void hlighting (const QRect&, int dy) const;
     void searchFlagChanged();
     void showHideSearch();
+    void findInAllTabs();
+    void findInFolder();
+    void showSearchResult (TabPage *tabPage, int line, int column, int length);
+    void showFileResult (const QString &fileName, int line, int column, int length);
     void showLN (bool checked);
     void toggleSyntaxHighlighting();
     void formatOnBlockChange (int) const;
@@ -206,6 +213,7 @@ private:
     void dropTab (QString str);
     void changeEvent (QEvent *event);
     QTextDocument::FindFlags getSearchFlags() const;
+    bool isRegexSearch() const;
     void enableWidgets (bool enable) const;
     void updateShortcuts (bool disable, bool page = true);
     QTextCursor finding (const QString str, const QTextCursor& start, QTextDocument::FindFlags flags = 0,
@@ -221,9 +229,15 @@ private:
     bool matchRightBrace (QTextBlock currentBlock, int index, int numLeftBraces);
     bool matchLeftBracket (QTextBlock currentBlock, int index, int numRightBrackets);
     bool matchRightBracket (QTextBlock currentBlock, int index, int numLeftBrackets);
+    QTextBlock matchingBlock (const QTextBlock &block, BracketIndex::Kind kind,
+                              int &depth, bool forward);
     void createSelection (int pos);
     void formatTextRect (QRect rect) const;
     void removeGreenSel();
+    void showReplacements (TextEdit *textEdit, const QList<QTextEdit::ExtraSelection> &gsel, int count);
+    void applyReplacements (TextEdit *textEdit, int textRevision,
+                            const QString &newText, int first, int last, int count,
+                            const QVector<int> &highlights);
     void waitToMakeBusy();
     void unbusy();
     void displayMessage (bool error);
@@ -232,6 +246,8 @@ private:
     void disconnectLambda();
     void changeTab (QListWidgetItem *current, QListWidgetItem*);
     void toggleSidePane();
+    void showResultsDock();
+    TextSearch *textSearch (const QString &str, QTextDocument::FindFlags flags, bool regex) const;
 
     QActionGroup *aGroup_;
     QString lastFile_; // The last opened or saved file (for file dialogs).
@@ -239,9 +255,14 @@ private:
     int rightClicked_; // The index/row of the right-clicked tab/item.
     int loadingProcesses_; // The number of loading processes (used to prevent early closing).
     QPointer<QThread> busyThread_; // Used to wait one second for making the cursor busy.
+    QPointer<QThread> replacingThread_; // Used for replacing regex matches.
     ICONMODE iconMode_; // Used only internally.
     QMetaObject::Connection lambdaConnection_; // Captures a lambda connection to disconnect it later.
     SidePane *sidePane_;
+    QDockWidget *resultsDock_; // Shows the matches in all tabs.
+    SearchResults *searchResults_;
+    QMetaObject::Connection resultConnection_; // Shows a search result after its file is opened.
+    mutable TextSearch *textSearch_; // The last compiled search, which is reused with the same text and flags.
     QHash<QListWidgetItem*, TabPage*> sideItems_; // For fast tab switching.
     // Auto-saving:
     QTimer *autoSaver_;
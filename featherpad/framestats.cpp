@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "framestats.h"
+#include <QPainter>
+#include <algorithm>
+
+#define RECENT_FRAMES 120
+#define MAX_SAMPLES 10000 // the number of the last times whose percentiles are printed
+#define BAR_WIDTH 2 // in pixels
+#define GRAPH_HEIGHT 64 // in pixels
+#define GRAPH_NSECS 33333333 // two frames at 60 Hz
+
+namespace FeatherPad {
+
+static const char *sectionNames[FrameStats::SectionCount] = {
+    "paintEvent",
+    "lineNumberAreaPaintEvent",
+    "formatTextRect",
+    "hlight",
+    "matchBrackets"
+};
+
+static const QColor sectionColors[FrameStats::SectionCount] = {
+    QColor (70, 130, 230),
+    QColor (0, 190, 190),
+    QColor (60, 180, 60),
+    QColor (220, 200, 0),
+    QColor (200, 80, 200)
+};
+
+FrameStats *FrameStats::instance_ = nullptr;
+int FrameTimer::depth_ = 0;
+
+/* the nearest-rank percentile of sorted values */
+static qint64 percentile (const QVector<qint64> &sorted, int p)
+{
+    if (sorted.isEmpty()) return 0;
+    int i = (sorted.size() * p + 99) / 100 - 1;
+    return sorted.at (qBound (0, i, sorted.size() - 1));
+}
+/*************************/
+static void printPercentiles (const char *name, const FrameSamples &samples)
+{
+    if (samples.values.isEmpty()) return;
+    QVector<qint64> values = samples.values;
+    std::sort (values.begin(), values.end());
+    qDebug ("Frames (%s): %lld, of the last %d: median: %lld ns, 90%%: %lld ns, 99%%: %lld ns, worst: %lld ns",
+            name, samples.count, values.size(),
+            percentile (values, 50), percentile (values, 90), percentile (values, 99),
+            samples.worst);
+}
+/*************************/
+void FrameSamples::add (qint64 nsecs)
+{
+    if (values.size() < MAX_SAMPLES)
+        values.append (nsecs);
+    else
+    {
+        values[next] = nsecs;
+        next = (next + 1) % MAX_SAMPLES;
+    }
+    ++count;
+    worst = qMax (worst, nsecs);
+}
+/*************************/
+FrameStats::FrameStats (QObject *parent) : QObject (parent)
+{
+    frameNsecs_ = 0;
+    for (int i = 0; i < SectionCount; ++i)
+        sectionNsecs_[i] = 0;
+    /* the frame ends when the event loop is reached */
+    frameTimer_ = new QTimer (this);
+    frameTimer_->setSingleShot (true);
+    frameTimer_->setInterval (0);
+    connect (frameTimer_, &QTimer::timeout, this, &FrameStats::endFrame);
+    instance_ = this;
+}
+/*************************/
+FrameStats::~FrameStats()
+{
+    instance_ = nullptr;
+    if (frameTimer_->isActive())
+        endFrame();
+    printPercentiles ("all", frames_);
+    for (int i = 0; i < SectionCount; ++i)
+        printPercentiles (sectionNames[i], sections_[i]);
+}
+/*************************/
+void FrameStats::add (Section section, qint64 nsecs, bool outermost)
+{
+    sections_[section].add (nsecs);
+    sectionNsecs_[section] += nsecs;
+    if (outermost)
+        frameNsecs_ += nsecs;
+    if (!frameTimer_->isActive())
+        frameTimer_->start();
+}
+/*************************/
+void FrameStats::endFrame()
+{
+    frames_.add (frameNsecs_);
+    recentFrames_.append (frameNsecs_);
+    if (recentFrames_.size() > RECENT_FRAMES)
+        recentFrames_.removeFirst();
+    for (int i = 0; i < SectionCount; ++i)
+    {
+        recentSections_[i].append (sectionNsecs_[i]);
+        if (recentSections_[i].size() > RECENT_FRAMES)
+            recentSections_[i].removeFirst();
+        sectionNsecs_[i] = 0;
+    }
+    frameNsecs_ = 0;
+    emit frameAdded();
+}
+/*************************/
+FrameTimer::FrameTimer (FrameStats::Section section) : section_ (section)
+{
+    if (FrameStats::instance())
+    {
+        ++depth_;
+        timer_.start();
+    }
+}
+/*************************/
+FrameTimer::~FrameTimer()
+{
+    if (timer_.isValid())
+    {
+        --depth_;
+        if (FrameStats *stats = FrameStats::instance())
+            stats->add (section_, timer_.nsecsElapsed(), depth_ == 0);
+    }
+}
+/*************************/
+FrameGraph::FrameGraph (FrameStats *stats, QWidget *parent) : QWidget (parent), stats_ (stats)
+{
+    /* the graph is painted completely and doesn't take the mouse */
+    setAttribute (Qt::WA_OpaquePaintEvent);
+    setAttribute (Qt::WA_TransparentForMouseEvents);
+    setFixedSize (RECENT_FRAMES * BAR_WIDTH, GRAPH_HEIGHT);
+    connect (stats, &FrameStats::frameAdded, this, [this] {
+        if (isVisible())
+            update();
+    });
+}
+/*************************/
+void FrameGraph::paintEvent (QPaintEvent* /*event*/)
+{
+    QPainter painter (this);
+    painter.fillRect (rect(), QColor (30, 30, 30));
+
+    /* a line for 60 Hz */
+    painter.setPen (QColor (120, 120, 120));
+    painter.drawLine (0, height() / 2, width(), height() / 2);
+
+    const QVector<qint64> &frames = stats_->recentFrames();
+    const int n = frames.size();
+    int x = width() - n * BAR_WIDTH;
+    qint64 worst = 0;
+    for (int i = 0; i < n; ++i, x += BAR_WIDTH)
+    {
+        const qint64 frame = frames.at (i);
+        worst = qMax (worst, frame);
+        int h = qMin ((qint64) height(), frame * height() / GRAPH_NSECS);
+        painter.fillRect (x, height() - h, BAR_WIDTH, h, QColor (160, 160, 160));
+
+        /* stack the sections on the bar (nested ones may not fit in it) */
+        int y = height();
+        for (int j = 0; j < FrameStats::SectionCount; ++j)
+        {
+            const qint64 section = stats_->recentSections ((FrameStats::Section) j).at (i);
+            int sh = qMin ((qint64) (y - height() + h), section * height() / GRAPH_NSECS);
+            if (sh <= 0) continue;
+            y -= sh;
+            painter.fillRect (x, y, BAR_WIDTH, sh, sectionColors[j]);
+        }
+    }
+
+    if (n > 0)
+    {
+        painter.setPen (Qt::white);
+        painter.drawText (rect().adjusted (3, 1, -3, -1), Qt::AlignLeft | Qt::AlignTop,
+                          QString ("%1 ms (worst: %2 ms)")
+                          .arg (frames.last() / 1000000.0, 0, 'f', 2)
+                          .arg (worst / 1000000.0, 0, 'f', 2));
+    }
+}
+
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QObject>
+#include <QWidget>
+#include <QTimer>
+#include <QVector>
+#include <QElapsedTimer>
+
+namespace FeatherPad {
+
+/* The last times of a frame or section in a ring buffer of a fixed size, so
+   that the memory usage doesn't grow in a long session. The number and the
+   worst of all times are also kept. */
+struct FrameSamples
+{
+    FrameSamples() : next (0), count (0), worst (0) {}
+    void add (qint64 nsecs);
+
+    QVector<qint64> values;
+    int next; // the index of the next value when the buffer is full
+    qint64 count;
+    qint64 worst;
+};
+
+/* Timings of the work that is done in the GUI thread for showing texts.
+   They're collected only if the environment variable FEATHERPAD_FRAME_STATS
+   is set, in which case the application makes the only instance.
+   A frame is all of the timed work that is done before returning to
+   the event loop. Percentiles of the last frames and sections are printed
+   when the instance is deleted. */
+class FrameStats : public QObject
+{
+    Q_OBJECT
+public:
+    enum Section {
+        Paint = 0, // TextEdit::paintEvent()
+        LineNumbers, // TextEdit::lineNumberAreaPaintEvent()
+        Format, // FPwin::formatTextRect() with its block rehighlighting
+        Highlight, // FPwin::hlight()
+        Brackets, // FPwin::matchBrackets()
+        SectionCount
+    };
+
+    FrameStats (QObject *parent = nullptr);
+    ~FrameStats();
+
+    /* nullptr if timings aren't collected */
+    static FrameStats *instance() {
+        return instance_;
+    }
+
+    void add (Section section, qint64 nsecs, bool outermost);
+
+    /* the times of the last frames in ns, the latest one at the end */
+    const QVector<qint64> &recentFrames() const {
+        return recentFrames_;
+    }
+    /* the times of the sections in the last frames, in parallel with recentFrames() */
+    const QVector<qint64> &recentSections (Section section) const {
+        return recentSections_[section];
+    }
+
+signals:
+    void frameAdded();
+
+private slots:
+    void endFrame();
+
+private:
+    static FrameStats *instance_;
+    QTimer *frameTimer_;
+    qint64 frameNsecs_;
+    qint64 sectionNsecs_[SectionCount];
+    FrameSamples frames_;
+    FrameSamples sections_[SectionCount];
+    QVector<qint64> recentFrames_;
+    QVector<qint64> recentSections_[SectionCount];
+};
+
+/* Times a section from its construction to its destruction (if timings
+   are collected). Sections inside others are timed but aren't counted
+   twice in the frame time. */
+class FrameTimer
+{
+public:
+    FrameTimer (FrameStats::Section section);
+    ~FrameTimer();
+
+private:
+    FrameStats::Section section_;
+    QElapsedTimer timer_;
+    static int depth_;
+};
+
+/* A rolling graph of frame times, which is shown over the text. */
+class FrameGraph : public QWidget
+{
+    Q_OBJECT
+public:
+    FrameGraph (FrameStats *stats, QWidget *parent = nullptr);
+
+protected:
+    void paintEvent (QPaintEvent *event);
+
+private:
+    FrameStats *stats_;
+};
+
+}
+
+#endif // FRAMESTATS_H
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "grepping.h"
+#include "textsearch.h"
+#include "encoding.h"
+#include <QElapsedTimer>
+#include <QDirIterator>
+#include <QFile>
+#include <QTextCodec>
+
+#define BATCH_TIME 50 // in ms
+#define MAX_MATCHES 1000 // per document
+#define MAX_PREVIEW 200 // in characters
+#define PREVIEW_CONTEXT 40 // the characters shown before a match in a long line
+#define MAX_FILE_SIZE 104857600 // 100 MiB, as with opening files
+#define LIST_BATCH 64 // the number of files that are added to the queue together
+
+namespace FeatherPad {
+
+GrepQueue::GrepQueue()
+{
+    next_ = 0;
+    finished_ = false;
+    canceled_ = false;
+}
+/*************************/
+void GrepQueue::add (const QStringList &files)
+{
+    if (files.isEmpty()) return;
+    QMutexLocker locker (&mutex_);
+    files_ += files;
+    added_.wakeAll();
+}
+/*************************/
+void GrepQueue::finish()
+{
+    QMutexLocker locker (&mutex_);
+    finished_ = true;
+    added_.wakeAll();
+}
+/*************************/
+void GrepQueue::cancel()
+{
+    QMutexLocker locker (&mutex_);
+    canceled_ = true;
+    added_.wakeAll();
+}
+/*************************/
+bool GrepQueue::take (QString &file, int &id)
+{
+    QMutexLocker locker (&mutex_);
+    while (next_ >= files_.size() && !finished_ && !canceled_)
+        added_.wait (&mutex_);
+    if (canceled_ || next_ >= files_.size())
+        return false;
+    id = next_++;
+    file = files_.at (id);
+    return true;
+}
+/*************************/
+QString GrepQueue::fileAt (int id)
+{
+    QMutexLocker locker (&mutex_);
+    return files_.value (id);
+}
+/*************************/
+Grepping::Grepping (const QList<int> &ids, const QStringList &texts, const QString &str,
+                    Qt::CaseSensitivity cs, bool wholeWords, bool regex, int generation) :
+    ids_ (ids),
+    texts_ (texts),
+    str_ (str),
+    cs_ (cs),
+    wholeWords_ (wholeWords),
+    regex_ (regex),
+    generation_ (generation)
+{}
+/*************************/
+Grepping::Grepping (QSharedPointer<GrepQueue> queue, const QString &dir, const QString &str,
+                    Qt::CaseSensitivity cs, bool wholeWords, bool regex, int generation) :
+    queue_ (queue),
+    dir_ (dir),
+    str_ (str),
+    cs_ (cs),
+    wholeWords_ (wholeWords),
+    regex_ (regex),
+    generation_ (generation)
+{
+    /* an ASCII string has the same bytes in all non-Unicode encodings */
+    if (!regex && cs == Qt::CaseSensitive)
+    {
+        bool ascii = true;
+        for (int i = 0; i < str.length(); ++i)
+        {
+            if (str.at (i).unicode() > 0x7f)
+            {
+                ascii = false;
+                break;
+            }
+        }
+        if (ascii)
+            matcher_.setPattern (str.toLatin1());
+    }
+}
+/*************************/
+Grepping::~Grepping() {}
+/*************************/
+static QString preview (const QString &text, int lineStart, int lineEnd, int pos)
+{
+    QString res;
+    if (lineEnd - lineStart <= MAX_PREVIEW)
+        res = text.mid (lineStart, lineEnd - lineStart);
+    else
+    { // show a part of a long line around the match
+        const int start = qMax (lineStart, qMin (pos - PREVIEW_CONTEXT, lineEnd - MAX_PREVIEW));
+        res = text.mid (start, MAX_PREVIEW);
+        if (start > lineStart)
+            res.prepend (QChar (0x2026));
+        if (start + MAX_PREVIEW < lineEnd)
+            res.append (QChar (0x2026));
+    }
+    if (res.endsWith ('\r'))
+        res.chop (1);
+    res.replace ('\t', ' ');
+    return res;
+}
+/*************************/
+void Grepping::run()
+{
+    TextSearch search (str_, cs_, wholeWords_, regex_);
+    if (!search.isValid()) return;
+
+    if (queue_)
+    {
+        if (!dir_.isEmpty())
+            listFiles();
+        QString file, text;
+        int id;
+        while (queue_->take (file, id))
+        {
+            if (isInterruptionRequested()) return;
+            if (readFile (file, text) && !grep (id, text, search))
+                return;
+        }
+        return;
+    }
+
+    for (int k = 0; k < ids_.size(); ++k)
+    {
+        if (!grep (ids_.at (k), texts_.at (k), search))
+            return;
+    }
+}
+/*************************/
+void Grepping::listFiles()
+{
+    /* hidden files and folders and symlinks to folders are skipped */
+    QDirIterator it (dir_, QDir::Files, QDirIterator::Subdirectories);
+    QStringList files;
+    while (it.hasNext() && !isInterruptionRequested())
+    {
+        files.append (it.next());
+        if (files.size() == LIST_BATCH)
+        {
+            queue_->add (files);
+            files.clear();
+        }
+    }
+    queue_->add (files);
+    queue_->finish();
+}
+/*************************/
+// Reads a text file in the way it's opened, but skips non-text files
+// and, if possible, files without matches, without reading them.
+bool Grepping::readFile (const QString &file, QString &text) const
+{
+    QFile f (file);
+    const qint64 size = f.size();
+    if (size == 0 || size > MAX_FILE_SIZE || !f.open (QFile::ReadOnly))
+        return false;
+
+    QByteArray data;
+    uchar *mapped = f.map (0, size);
+    if (mapped)
+        data = QByteArray::fromRawData (reinterpret_cast<const char*>(mapped), size);
+    else
+        data = f.readAll();
+
+    QString charset = detectUnicodeCharset (reinterpret_cast<const unsigned char*>(data.constData()),
+                                            qMin (data.size(), 4));
+    if (charset.isEmpty())
+    {
+        if (data.contains ('\0'))
+            return false; // a non-text file
+        if (!matcher_.pattern().isEmpty() && matcher_.indexIn (data) == -1)
+            return false;
+        if (mapped) // detectCharset() needs a null-terminated string
+            data = QByteArray (data.constData(), data.size());
+        charset = detectCharset (data);
+    }
+
+    QTextCodec *codec = QTextCodec::codecForName (charset.toUtf8());
+    if (!codec)
+        codec = QTextCodec::codecForName ("UTF-8");
+    text = codec->toUnicode (data);
+    return true;
+}
+/*************************/
+// Returns false if the thread is interrupted.
+bool Grepping::grep (int id, const QString &text, TextSearch &search)
+{
+    search.setTextRevision (id);
+    QElapsedTimer timer;
+    timer.start();
+    QVector<int> lines, columns, lengths;
+    QStringList previews;
+    bool more = false;
+    int line = 0, lineStart = 0;
+    int lineEnd = text.indexOf ('\n');
+    if (lineEnd < 0)
+        lineEnd = text.length();
+    int count = 0, pos = 0, l;
+    while ((pos = search.indexIn (text, pos, -1, &l)) >= 0)
+    {
+        if (isInterruptionRequested()) return false;
+        if (++count > MAX_MATCHES)
+        {
+            more = true;
+            break;
+        }
+        /* a match starting at a line end belongs to its line */
+        while (lineEnd < pos)
+        {
+            lineStart = lineEnd + 1;
+            ++line;
+            lineEnd = text.indexOf ('\n', lineStart);
+            if (lineEnd < 0)
+                lineEnd = text.length();
+        }
+        lines.append (line);
+        columns.append (pos - lineStart);
+        lengths.append (l);
+        previews.append (preview (text, lineStart, lineEnd, pos));
+        pos += l;
+        if (timer.elapsed() > BATCH_TIME)
+        {
+            emit found (generation_, id, lines, columns, lengths, previews, false);
+            lines.clear();
+            columns.clear();
+            lengths.clear();
+            previews.clear();
+            timer.restart();
+        }
+    }
+    if (!lines.isEmpty() || more)
+        emit found (generation_, id, lines, columns, lengths, previews, more);
+    return true;
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef GREPPING_H
+#define GREPPING_H
+
+#include <QThread>
+#include <QVector>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArrayMatcher>
+
+namespace FeatherPad {
+
+class TextSearch;
+
+/* The files of a folder search, which are added by one thread while
+   others take them one by one. A file's index is its ID in results. */
+class GrepQueue {
+public:
+    GrepQueue();
+
+    void add (const QStringList &files);
+    /* no file will be added after this */
+    void finish();
+    /* no file will be taken after this */
+    void cancel();
+    /* Waits until there's a file to take. Returns false if there's
+       no file left or the search is canceled. */
+    bool take (QString &file, int &id);
+    QString fileAt (int id);
+
+private:
+    QMutex mutex_;
+    QWaitCondition added_;
+    QStringList files_;
+    int next_;
+    bool finished_;
+    bool canceled_;
+};
+
+/* Finds all matches in copies of the texts of some documents and gives
+   them to the GUI thread with their line numbers and lines, document by
+   document (and in batches for large documents). Results of a search that
+   is replaced by another one are recognized by their generation.
+   In a folder search, the threads share a queue of files, which one of
+   them fills before searching. The files are memory-mapped to skip
+   binary files and (with case-sensitive ASCII strings) files without
+   matches before reading them as texts. */
+class Grepping : public QThread {
+    Q_OBJECT
+
+public:
+    Grepping (const QList<int> &ids, const QStringList &texts, const QString &str,
+              Qt::CaseSensitivity cs, bool wholeWords, bool regex, int generation);
+    /* searches the files of the queue and, if "dir" isn't empty, finds them first */
+    Grepping (QSharedPointer<GrepQueue> queue, const QString &dir, const QString &str,
+              Qt::CaseSensitivity cs, bool wholeWords, bool regex, int generation);
+    ~Grepping();
+
+signals:
+    /* Lines are 0-based and previews are (parts of) the lines of matches.
+       "more" is true if the document has more matches than can be shown. */
+    void found (int generation, int id, const QVector<int> lines, const QVector<int> columns,
+                const QVector<int> lengths, const QStringList previews, bool more);
+
+private:
+    void run();
+    void listFiles();
+    bool readFile (const QString &file, QString &text) const;
+    bool grep (int id, const QString &text, TextSearch &search);
+
+    QList<int> ids_;
+    QStringList texts_;
+    QSharedPointer<GrepQueue> queue_;
+    QString dir_;
+    QString str_;
+    Qt::CaseSensitivity cs_;
+    bool wholeWords_;
+    bool regex_;
+    int generation_;
+    QByteArrayMatcher matcher_; // finds files that may have matches in a folder search
+};
+
+}
+
+#endif // GREPPING_H
@@ -21,6 +21,31 @@
 
 namespace FeatherPad {
 
+/* Searching for an expression in a line from increasing positions is linear
+   in total if the last match is remembered, because the first match after a
+   position is the same as before as long as that position isn't after it. */
+struct ForwardSearch
+{
+    ForwardSearch (QRegExp &exp) : expression (exp), from (-1), index (-1), length (0) {}
+
+    int indexIn (const QString &text, int pos) {
+        if (from < 0 || pos < from || (index > -1 && pos > index))
+        {
+            from = pos;
+            index = expression.indexIn (text, pos);
+            length = expression.matchedLength();
+        }
+        return index;
+    }
+    int matchedLength() const {
+        return length;
+    }
+
+private:
+    QRegExp &expression;
+    int from, index, length;
+};
+/*************************/
 // This should be called before "htmlCSSHighlighter()" and "htmlJavascript()".
 void Highlighter::htmlBrackets (const QString &text, const int start)
 {
@@ -32,9 +57,10 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
 
     int braIndex = start;
     int indx = 0;
-    QRegExp braStartExp = QRegExp ("<(?!\\!)/{,1}[A-Za-z0-9_\\-]+");
-    QRegExp braEndExp = QRegExp (">");
-    QRegExp styleExp = QRegExp ("<(style|STYLE)$|<(style|STYLE)\\s+[^>]*");
+    ForwardSearch braStartExp (htmlBraStartExp);
+    ForwardSearch styleExp (htmlStyleExp);
+    ForwardSearch quoteExp (htmlQuoteExp);
+    ForwardSearch attExp (htmlAttExp);
     bool isStyle (false);
     QTextCharFormat htmlBraFormat;
     htmlBraFormat.setFontWeight (QFont::Bold);
@@ -46,12 +72,12 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
             && (prevState < htmlBracketState || prevState > htmlStyleSingleQuoteState)))
     {
         braIndex = braStartExp.indexIn (text, start);
-        while (format (braIndex) == commentFormat || format (braIndex) == urlFormat)
+        while (tokenClass (braIndex) == commentClass || tokenClass (braIndex) == urlClass)
             braIndex = braStartExp.indexIn (text, braIndex + 1);
         if (braIndex > -1)
         {
             indx = styleExp.indexIn (text, start);
-            while (format (indx) == commentFormat || format (indx) == urlFormat)
+            while (tokenClass (indx) == commentClass || tokenClass (indx) == urlClass)
                 indx = styleExp.indexIn (text, indx + 1);
             isStyle = indx > -1 && braIndex == indx;
         }
@@ -82,13 +108,12 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
             && (prevState == singleQuoteState || prevState == doubleQuoteState
                 || (prevState >= htmlBracketState && prevState <= htmlStyleSingleQuoteState)))
         {
-            braEndIndex = braEndExp.indexIn (text, 0);
+            braEndIndex = text.indexOf ('>');
         }
         else
         {
             matched = braStartExp.matchedLength();
-            braEndIndex = braEndExp.indexIn (text,
-                                             braIndex + matched);
+            braEndIndex = text.indexOf ('>', braIndex + matched);
         }
 
         int len;
@@ -102,14 +127,13 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
         }
         else
         {
-            len = braEndIndex - braIndex
-                  + braEndExp.matchedLength();
+            len = braEndIndex - braIndex + 1;
         }
 
         if (matched > 0)
             setFormat (braIndex, matched, htmlBraFormat);
         if (braEndIndex > -1)
-            setFormat (braEndIndex, braEndExp.matchedLength(), htmlBraFormat);
+            setFormat (braEndIndex, 1, htmlBraFormat);
 
 
         int endLimit;
@@ -123,7 +147,7 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
          ***************************/
 
         int quoteIndex = braIndex;
-        QRegExp quoteExpression = QRegExp ("\"|\'");
+        QChar quoteChar; // null as long as the quote kind isn't known
         int quote = doubleQuoteState;
 
         /* find the start quote */
@@ -133,25 +157,7 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
                 && prevState != htmlStyleSingleQuoteState
                 && prevState != htmlStyleDoubleQuoteState))
         {
-            quoteIndex = quoteExpression.indexIn (text, braIndex);
-
-            /* if the start quote is found... */
-            if (quoteIndex >= braIndex && quoteIndex <= endLimit)
-            {
-                /* ... distinguish between double and single quotes */
-                if (quoteIndex == quoteMark.indexIn (text, quoteIndex))
-                {
-                    quoteExpression = quoteMark;
-                    quote = currentBlockState() == htmlStyleState ? htmlStyleDoubleQuoteState
-                                                                  : doubleQuoteState;
-                }
-                else
-                {
-                    quoteExpression = QRegExp ("\'");
-                    quote = currentBlockState() == htmlStyleState ? htmlStyleSingleQuoteState
-                                                                  : singleQuoteState;
-                }
-            }
+            quoteIndex = quoteExp.indexIn (text, braIndex);
         }
         else // but if we're inside a quotation...
         {
@@ -159,40 +165,37 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
                by checking the previous line */
             quote = prevState;
             if (quote == doubleQuoteState || quote == htmlStyleDoubleQuoteState)
-                quoteExpression = quoteMark;
+                quoteChar = '\"';
             else
-                quoteExpression = QRegExp ("\'");
+                quoteChar = '\'';
         }
 
         while (quoteIndex >= braIndex && quoteIndex <= endLimit)
         {
-            /* if the search is continued... */
-            if (quoteExpression == QRegExp ("\"|\'"))
+            /* if a start quote is found, distinguish between double and single quotes */
+            if (quoteChar.isNull())
             {
-                /* ... distinguish between double and single quotes
-                   again because the quote mark may have changed */
-                if (quoteIndex == quoteMark.indexIn (text, quoteIndex))
+                quoteChar = text.at (quoteIndex);
+                if (quoteChar == '\"')
                 {
-                    quoteExpression = quoteMark;
                     quote = currentBlockState() == htmlStyleState ? htmlStyleDoubleQuoteState
                                                                   : doubleQuoteState;
                 }
                 else
                 {
-                    quoteExpression = QRegExp ("\'");
                     quote = currentBlockState() == htmlStyleState ? htmlStyleSingleQuoteState
                                                                   : singleQuoteState;
                 }
             }
 
-            int quoteEndIndex = quoteExpression.indexIn (text, quoteIndex + 1);
+            int quoteEndIndex = text.indexOf (quoteChar, quoteIndex + 1);
             if (quoteIndex == braIndex
                 && (prevState == doubleQuoteState
                     || prevState == singleQuoteState
                     || prevState == htmlStyleSingleQuoteState
                     || prevState == htmlStyleDoubleQuoteState))
             {
-                quoteEndIndex = quoteExpression.indexIn (text, braIndex);
+                quoteEndIndex = text.indexOf (quoteChar, braIndex);
             }
 
             int Matched = 0;
@@ -205,7 +208,7 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
                 if (quoteEndIndex > endLimit)
                     quoteEndIndex = endLimit;
                 else
-                    Matched = quoteExpression.matchedLength();
+                    Matched = 1;
             }
 
             int quoteLength;
@@ -221,12 +224,12 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
             else
                 quoteLength = quoteEndIndex - quoteIndex
                               + Matched;
-            setFormat (quoteIndex, quoteLength, quoteExpression == quoteMark ? quoteFormat
-                                                                             : altQuoteFormat);
+            setFormat (quoteIndex, quoteLength, quoteChar == '\"' ? quoteFormat
+                                                                   : altQuoteFormat);
 
             /* the next quote may be different */
-            quoteExpression = QRegExp ("\"|\'");
-            quoteIndex = quoteExpression.indexIn (text, quoteIndex + quoteLength);
+            quoteChar = QChar();
+            quoteIndex = quoteExp.indexIn (text, quoteIndex + quoteLength);
         }
 
         /*******************************
@@ -238,10 +241,9 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
             QTextCharFormat htmlAttributeFormat;
             htmlAttributeFormat.setFontItalic (true);
             htmlAttributeFormat.setForeground (Brown);
-            QRegExp attExp = QRegExp ("[A-Za-z0-9_\\-]+(?=\\s*\\=)");
             int attIndex = attExp.indexIn (text, braIndex);
-            while (format (attIndex) == quoteFormat
-                   || format (attIndex) == altQuoteFormat)
+            while (tokenClass (attIndex) == quoteClass
+                   || tokenClass (attIndex) == altQuoteClass)
             {
                 attIndex = attExp.indexIn (text, attIndex + attExp.matchedLength());
             }
@@ -250,8 +252,8 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
                 int length = attExp.matchedLength();
                 setFormat (attIndex, length, htmlAttributeFormat);
                 attIndex = attExp.indexIn (text, attIndex + length);
-                while (format (attIndex) == quoteFormat
-                       || format (attIndex) == altQuoteFormat)
+                while (tokenClass (attIndex) == quoteClass
+                       || tokenClass (attIndex) == altQuoteClass)
                 {
                     attIndex = attExp.indexIn (text, attIndex + attExp.matchedLength());
                 }
@@ -260,12 +262,12 @@ void Highlighter::htmlBrackets (const QString &text, const int start)
 
         indx = braIndex + len;
         braIndex = braStartExp.indexIn (text, braIndex + len);
-        while (format (braIndex) == commentFormat || format (braIndex) == urlFormat)
+        while (tokenClass (braIndex) == commentClass || tokenClass (braIndex) == urlClass)
             braIndex = braStartExp.indexIn (text, braIndex + 1);
         if (braIndex > -1)
         {
             indx = styleExp.indexIn (text, indx);
-            while (format (indx) == commentFormat || format (indx) == urlFormat)
+            while (tokenClass (indx) == commentClass || tokenClass (indx) == urlClass)
                 indx = styleExp.indexIn (text, indx + 1);
             isStyle = indx > -1 && braIndex == indx;
         }
@@ -299,13 +301,12 @@ void Highlighter::htmlCSSHighlighter (const QString &text, const int start)
 
     int cssIndex = start;
 
-    QRegExp cssStartExp = QRegExp ("<(style|STYLE)>|<(style|STYLE)\\s+[^>]*>");
-    QRegExp cssEndExp = QRegExp ("</(style|STYLE)\\s*>");
-    QRegExp braEndExp = QRegExp (">");
+    ForwardSearch cssStartExp (htmlCSSStartExp);
+    ForwardSearch cssEndExp (htmlCSSEndExp);
 
     /* switch to css temporarily */
-    commentStartExpression = QRegExp ("/\\*");
-    commentEndExpression = QRegExp ("\\*/");
+    commentStartExpression = cCommentStartExp;
+    commentEndExpression = cCommentEndExp;
     progLan = "css";
 
     bool wasCSS (false);
@@ -320,33 +321,33 @@ void Highlighter::htmlCSSHighlighter (const QString &text, const int start)
             wasCSS = prevData->labelInfo() == "CSS"; // it's labeled below
     }
 
-    QTextCharFormat fi;
+    int tc;
     int matched = 0;
     if ((!wasCSS || start > 0)  && !wasStyle)
     {
         cssIndex = cssStartExp.indexIn (text, start);
-        fi = format (cssIndex);
+        tc = tokenClass (cssIndex);
         while (cssIndex >= 0
-               && (fi == commentFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+               && (tc == commentClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
             cssIndex = cssStartExp.indexIn (text, cssIndex + cssStartExp.matchedLength());
-            fi = format (cssIndex);
+            tc = tokenClass (cssIndex);
         }
     }
     else if (wasStyle)
     {
-        cssIndex = braEndExp.indexIn (text, start);
-        fi = format (cssIndex);
+        cssIndex = text.indexOf ('>', start);
+        tc = tokenClass (cssIndex);
         while (cssIndex >= 0
-               && (fi == commentFormat || fi == urlFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+               && (tc == commentClass || tc == urlClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
-            cssIndex = braEndExp.indexIn (text, cssIndex + 1);
-            fi = format (cssIndex);
+            cssIndex = text.indexOf ('>', cssIndex + 1);
+            tc = tokenClass (cssIndex);
         }
         if (cssIndex > -1)
-            matched = braEndExp.matchedLength(); // 1
+            matched = 1;
     }
     TextBlockData *curData = static_cast<TextBlockData *>(currentBlock().userData());
     int bn = currentBlock().blockNumber();
@@ -399,13 +400,13 @@ void Highlighter::htmlCSSHighlighter (const QString &text, const int start)
                                                cssIndex + matched);
         }
 
-        fi = format (cssEndIndex);
+        tc = tokenClass (cssEndIndex);
         while (cssEndIndex > -1
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass))
         {
             cssEndIndex = cssEndExp.indexIn (text, cssEndIndex + cssEndExp.matchedLength());
-            fi = format (cssEndIndex);
+            tc = tokenClass (cssEndIndex);
         }
 
         int len;
@@ -432,21 +433,21 @@ void Highlighter::htmlCSSHighlighter (const QString &text, const int start)
         }
 
         cssIndex = cssStartExp.indexIn (text, cssIndex + len);
-        fi = format (cssIndex);
+        tc = tokenClass (cssIndex);
         while (cssIndex >= 0
-               && (fi == commentFormat || fi == urlFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+               && (tc == commentClass || tc == urlClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
             cssIndex = cssStartExp.indexIn (text, cssIndex + cssStartExp.matchedLength());
-            fi = format (cssIndex);
+            tc = tokenClass (cssIndex);
         }
         matched = 0; // single-line style bracket (<style ...>)
     }
 
     /* revert to html */
     progLan = "html";
-    commentStartExpression = QRegExp ("<!--");
-    commentEndExpression = QRegExp ("-->");
+    commentStartExpression = htmlCommentStartExp;
+    commentEndExpression = htmlCommentEndExp;
 }
 /*************************/
 void Highlighter::htmlJavascript (const QString &text)
@@ -455,12 +456,12 @@ void Highlighter::htmlJavascript (const QString &text)
 
     int javaIndex = 0;
 
-    QRegExp javaStartExp = QRegExp ("<(script|SCRIPT)\\s+(language|LANGUAGE)\\s*\\=\\s*\"\\s*JavaScript\\s*\"[A-Za-z0-9_\\.\"\\s\\=]*>");
-    QRegExp javaEndExp = QRegExp ("</(script|SCRIPT)\\s*>");
+    ForwardSearch javaStartExp (htmlJSStartExp);
+    ForwardSearch javaEndExp (htmlJSEndExp);
 
     /* switch to javascript temporarily */
-    commentStartExpression = QRegExp ("/\\*");
-    commentEndExpression = QRegExp ("\\*/");
+    commentStartExpression = cCommentStartExp;
+    commentEndExpression = cCommentEndExp;
     progLan = "javascript";
 
     bool wasJavascript (false);
@@ -471,17 +472,17 @@ void Highlighter::htmlJavascript (const QString &text)
             wasJavascript = prevData->labelInfo() == "JS"; // it's labeled below
     }
 
-    QTextCharFormat fi;
+    int tc;
     if (!wasJavascript)
     {
         javaIndex = javaStartExp.indexIn (text);
-        fi = format (javaIndex);
+        tc = tokenClass (javaIndex);
         while (javaIndex >= 0
-               && (fi == commentFormat || fi == urlFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+               && (tc == commentClass || tc == urlClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
             javaIndex = javaStartExp.indexIn (text, javaIndex + javaStartExp.matchedLength());
-            fi = format (javaIndex);
+            tc = tokenClass (javaIndex);
         }
     }
     int matched = 0;
@@ -519,13 +520,13 @@ void Highlighter::htmlJavascript (const QString &text)
                 int index = expression.indexIn (text, javaIndex + matched);
                 if (rule.format != whiteSpaceFormat)
                 {
-                    fi = format (index);
+                    tc = tokenClass (index);
                     while (index >= 0
-                           && (fi == quoteFormat || fi == altQuoteFormat
-                               || fi == commentFormat || fi == urlFormat))
+                           && (tc == quoteClass || tc == altQuoteClass
+                               || tc == commentClass || tc == urlClass))
                     {
                         index = expression.indexIn (text, index + expression.matchedLength());
-                        fi = format (index);
+                        tc = tokenClass (index);
                     }
                 }
 
@@ -537,14 +538,14 @@ void Highlighter::htmlJavascript (const QString &text)
 
                     if (rule.format != whiteSpaceFormat)
                     {
-                        fi = format (index);
+                        tc = tokenClass (index);
                         while (index >= 0
-                               && (fi == quoteFormat || fi == altQuoteFormat
-                                   || fi == commentFormat || fi == urlFormat
-                                   || fi == JSRegexFormat))
+                               && (tc == quoteClass || tc == altQuoteClass
+                                   || tc == commentClass || tc == urlClass
+                                   || tc == JSRegexClass))
                         {
                             index = expression.indexIn (text, index + expression.matchedLength());
-                            fi = format (index);
+                            tc = tokenClass (index);
                         }
                     }
                 }
@@ -561,14 +562,14 @@ void Highlighter::htmlJavascript (const QString &text)
                                                javaIndex + matched);
         }
 
-        fi = format (javaEndIndex);
+        tc = tokenClass (javaEndIndex);
         while (javaEndIndex > -1
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             javaEndIndex = javaEndExp.indexIn (text, javaEndIndex + javaEndExp.matchedLength());
-            fi = format (javaEndIndex);
+            tc = tokenClass (javaEndIndex);
         }
 
         int len;
@@ -596,20 +597,20 @@ void Highlighter::htmlJavascript (const QString &text)
         }
 
         javaIndex = javaStartExp.indexIn (text, javaIndex + len);
-        fi = format (javaEndIndex);
+        tc = tokenClass (javaIndex);
         while (javaIndex > -1
-               && (fi == commentFormat || fi == urlFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+               && (tc == commentClass || tc == urlClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
             javaIndex = javaStartExp.indexIn (text, javaIndex + javaStartExp.matchedLength());
-            fi = format (javaEndIndex);
+            tc = tokenClass (javaIndex);
         }
     }
 
     /* revert to html */
     progLan = "html";
-    commentStartExpression = QRegExp ("<!--");
-    commentEndExpression = QRegExp ("-->");
+    commentStartExpression = htmlCommentStartExp;
+    commentEndExpression = htmlCommentEndExp;
 }
 
 }
@@ -21,6 +21,64 @@
 
 namespace FeatherPad {
 
+/* Find the last non-space character before or at "pos" (-1 if none). */
+static int lastNonSpace (const QString &text, int pos)
+{
+    while (pos >= 0 && text.at (pos).isSpace())
+        --pos;
+    return pos;
+}
+/*************************/
+/* Decide whether a regex can come after the previous significant token,
+   which ends at "last". A regex can follow an operator or punctuation and
+   a few keywords but not an identifier, a number or a closing bracket. */
+static bool regexCanFollow (const QString &text, const int last)
+{
+    QChar ch = text.at (last);
+    if (ch == ')' || ch == ']') // as with Kate
+        return false;
+    if (!ch.isLetterOrNumber() && ch != '_' && ch != '$')
+        return true;
+
+    int start = last;
+    while (start > 0)
+    {
+        ch = text.at (start - 1);
+        if (!ch.isLetterOrNumber() && ch != '_' && ch != '$')
+            break;
+        --start;
+    }
+    static const char *const expressionKeywords[] = {"return", "typeof", "instanceof", "in", "of",
+                                                     "new", "delete", "void", "throw", "case",
+                                                     "do", "else", "yield", "await"};
+    const QStringRef word = text.midRef (start, last - start + 1);
+    for (const char *keyword : expressionKeywords)
+    {
+        if (word == QLatin1String (keyword))
+            return true;
+    }
+    return false;
+}
+/*************************/
+/* Find the end sign of a regex, i.e., "/" with its probable flags. */
+static int regexEndIndex (const QString &text, const int from, int &length)
+{
+    length = 0;
+    int index = text.indexOf ('/', from);
+    if (index > -1)
+    {
+        int i = index + 1;
+        while (i < text.length()
+               && text.at (i).unicode() < 128
+               && (text.at (i).isLetterOrNumber() || text.at (i) == '_'))
+        {
+            ++i;
+        }
+        length = i - index;
+    }
+    return index;
+}
+/*************************/
 // This is only for the starting "/".
 bool Highlighter::isEscapedJSRegex (const QString &text, const int pos)
 {
@@ -33,73 +91,35 @@ bool Highlighter::isEscapedJSRegex (const QString &text, const int pos)
         || (pos > 0 && (text.at (pos - 1) == '<'
                         || (text.at (pos - 1) == '/'
                             /* not the end of (a previously formatted) JS regex */
-                            && format (pos - 1) != JSRegexFormat))))
+                            && tokenClass (pos - 1) != JSRegexClass))))
     {
         return true;
     }
 
-    static QRegExp keys;
-
-    int i = pos - 1;
-    while (i >= 0 && (text.at (i) == ' ' || text.at (i) == '\t'))
-        --i;
-    if (i == -1)
-    { // examine the previous line(s)
-        QTextBlock prev = currentBlock().previous();
-        if (!prev.isValid()) return false;
-        QString txt = prev.text();
-        QRegExp nonSpace ("[^\\s]+");
-        while (nonSpace.indexIn (txt, 0) == -1)
-        {
-            prev.setUserState (updateState); // update the next line if this one changes
-            prev = prev.previous();
-            if (!prev.isValid()) return false;
-            txt = prev.text();
-        }
-        int last = txt.length() - 1;
-        QChar ch = txt.at (last);
-        while (ch == ' ' || ch == '\t')
-        {
-            --last;
-            ch = txt.at (last);
-        }
-        if (prev.userState() == JSRegexEndState)
+    int i = lastNonSpace (text, pos - 1);
+    if (i > -1)
+    {
+        if (tokenClass (i) == JSRegexClass)
             return false; // a regex isn't escaped if it follows another one
-        else
-        {
-            prev.setUserState (updateState); // update the next line if this one changes
-            if (ch.isLetterOrNumber() || ch == '_'
-                || ch == ')' || ch == ']') // as with Kate
-            { // a regex isn't escaped if it follows a JavaScript keyword
-                if (keys.isEmpty())
-                    keys = QRegExp (keywords (progLan).join ('|'));
-                int len = qMin (12, last + 1);
-                QString str = txt.mid (last - len + 1, len);
-                int j;
-                if ((j = keys.lastIndexIn (str)) > -1 && j + keys.matchedLength() == len)
-                    return false;
-                return true;
-            }
-        }
+        return !regexCanFollow (text, i);
     }
-    else
+
+    /* examine the previous line(s) */
+    QTextBlock prev = currentBlock().previous();
+    if (!prev.isValid()) return false;
+    QString txt = prev.text();
+    int last;
+    while ((last = lastNonSpace (txt, txt.length() - 1)) == -1)
     {
-        QChar ch = text.at (i);
-        if (format (i) != JSRegexFormat && (ch.isLetterOrNumber() || ch == '_'
-                                            || ch == ')' || ch == ']')) // as with Kate
-        { // a regex isn't escaped if it follows a JavaScript keyword
-            if (keys.isEmpty())
-                keys = QRegExp (keywords (progLan).join ('|'));
-            int len = qMin (12, i + 1);
-            QString str = text.mid (i - len + 1, len);
-            int j;
-            if ((j = keys.lastIndexIn (str)) > -1 && j + keys.matchedLength() == len)
-                return false;
-            return true;
-        }
+        prev.setUserState (updateState); // update the next line if this one changes
+        prev = prev.previous();
+        if (!prev.isValid()) return false;
+        txt = prev.text();
     }
-
-    return false;
+    if (prev.userState() == JSRegexEndState)
+        return false; // a regex isn't escaped if it follows another one
+    prev.setUserState (updateState); // update the next line if this one changes
+    return !regexCanFollow (txt, last);
 }
 /*************************/
 // This should be used with care because it gives correct results only in special places.
@@ -108,23 +128,29 @@ bool Highlighter::isInsideJSRegex (const QString &text, const int index)
     if (index < 0) return false;
     if (progLan != "javascript") return false;
 
-    QRegExp exp ("/");
-    bool res = false;
+    /* "index" and "pos" may be equal, as when "//" is at the end of "/...//" */
+    if (JSRegexSpans.isValid (spanGeneration, 0, text.length()))
+        return JSRegexSpans.isInside (index - 1);
+
     int pos = -1;
     int N;
 
     if (previousBlockState() != JSRegexState)
         N = 0;
     else
-    {
         N = 1;
-        res = true;
-    }
 
-    while ((pos = exp.indexIn (text, pos + 1)) >= 0)
+    JSRegexSpans.generation = spanGeneration;
+    JSRegexSpans.key = 0;
+    JSRegexSpans.length = text.length();
+    JSRegexSpans.initial = N;
+    JSRegexSpans.startsInside = (N == 1);
+    JSRegexSpans.toggles.clear();
+
+    while ((pos = text.indexOf ('/', pos + 1)) >= 0)
     {
         /* skip formatted comments and quotes */
-        if (format (pos) == commentFormat || format (pos) == quoteFormat || format (pos) == altQuoteFormat)
+        if (tokenClass (pos) == commentClass || tokenClass (pos) == quoteClass || tokenClass (pos) == altQuoteClass)
             continue;
 
         ++N;
@@ -135,19 +161,10 @@ bool Highlighter::isInsideJSRegex (const QString &text, const int index)
             continue;
         }
 
-        if (index <= pos) // they may be equal, as when "//" is at the end of "/...//"
-        {
-            if (N % 2 == 0) res = true;
-            else res = false;
-            break;
-        }
-
-        /* "pos" might be negative next time */
-        if (N % 2 == 0) res = false;
-        else res = true;
+        JSRegexSpans.toggles.append (pos);
     }
 
-    return res;
+    return JSRegexSpans.isInside (index - 1);
 }
 /*************************/
 void Highlighter::multiLineJSRegex (const QString &text, const int index)
@@ -156,23 +173,22 @@ void Highlighter::multiLineJSRegex (const QString &text, const int index)
     if (progLan != "javascript") return;
 
     int startIndex = index;
-    QRegExp startExp ("/");
-    QRegExp endExp ("/[A-Za-z0-9_]*");
-    QTextCharFormat fi;
+    int endLength;
+    int tc;
 
     int prevState = previousBlockState();
     if (prevState != JSRegexState || startIndex > 0)
     {
-        startIndex = startExp.indexIn (text, startIndex);
+        startIndex = text.indexOf ('/', startIndex);
         /* skip comments and quotations (all formatted to this point) */
-        fi = format (startIndex);
+        tc = tokenClass (startIndex);
         while (startIndex >= 0
                && (isEscapedJSRegex (text, startIndex)
-                   || fi == commentFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+                   || tc == commentClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
-            startIndex = startExp.indexIn (text, startIndex + 1);
-            fi = format (startIndex);
+            startIndex = text.indexOf ('/', startIndex + 1);
+            tc = tokenClass (startIndex);
         }
     }
 
@@ -183,12 +199,12 @@ void Highlighter::multiLineJSRegex (const QString &text, const int index)
            and the search for the end sign has just begun,
            search for the end sign from the line start */
         if (prevState == JSRegexState && startIndex == 0)
-            endIndex = endExp.indexIn (text, 0);
+            endIndex = regexEndIndex (text, 0, endLength);
         else
-            endIndex = endExp.indexIn (text, startIndex + startExp.matchedLength());
+            endIndex = regexEndIndex (text, startIndex + 1, endLength);
 
         while (isEscapedChar (text, endIndex))
-            endIndex = endExp.indexIn (text, endIndex + 1);
+            endIndex = regexEndIndex (text, endIndex + 1, endLength);
 
         int len;
         if (endIndex == -1)
@@ -199,21 +215,21 @@ void Highlighter::multiLineJSRegex (const QString &text, const int index)
         else
         {
             len = endIndex - startIndex
-                  + endExp.matchedLength();
+                  + endLength;
         }
         setFormat (startIndex, len, JSRegexFormat);
 
-        startIndex = startExp.indexIn (text, startIndex + len);
+        startIndex = text.indexOf ('/', startIndex + len);
 
         /* skip comments and quotations again */
-        fi = format (startIndex);
+        tc = tokenClass (startIndex);
         while (startIndex >= 0
                && (isEscapedJSRegex (text, startIndex)
-                   || fi == commentFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+                   || tc == commentClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
-            startIndex = startExp.indexIn (text, startIndex + 1);
-            fi = format (startIndex);
+            startIndex = text.indexOf ('/', startIndex + 1);
+            tc = tokenClass (startIndex);
         }
     }
 
@@ -230,7 +246,7 @@ void Highlighter::multiLineJSRegex (const QString &text, const int index)
             if (last < 0) return;
             ch = text.at (last);
         }
-        if (format (last) == JSRegexFormat)
+        if (tokenClass (last) == JSRegexClass)
             setCurrentBlockState (JSRegexEndState);
     }
 }
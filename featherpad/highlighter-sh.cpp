@@ -156,11 +156,11 @@ bool Highlighter::SH_SkipQuote (const QString &text, const int pos, bool isStart
 {
     if (isEscapedQuote (text, pos, isStartQuote))
         return true;
-    QTextCharFormat fi = format (pos);
-    return (fi == neutralFormat // not needed
-            || fi == commentFormat
-            || fi == quoteFormat
-            || fi == altQuoteFormat);
+    int tc = tokenClass (pos);
+    return (tc == neutralClass // not needed
+            || tc == commentClass
+            || tc == quoteClass
+            || tc == altQuoteClass);
 }
 /*************************/
 // Formats the text inside a command substitution variable character by character,
@@ -176,7 +176,7 @@ int Highlighter::formatInsideCommand (const QString &text,
     int initialOpenNests = nests;
     while (nests > minOpenNests && indx < text.length())
     {
-        while (format (indx) == commentFormat)
+        while (tokenClass (indx) == commentClass)
             ++ indx;
         if (indx == text.length())
             break;
@@ -425,7 +425,7 @@ bool Highlighter::SH_CmndSubstVar (const QString &text,
         if (N == 0)
         { // search for the first code block (after the previous one is closed)
             int start = QRegExp ("\\$\\(").indexIn (text, indx);
-            if (start == -1 || format (start) == commentFormat)
+            if (start == -1 || tokenClass (start) == commentClass)
                 goto FINISH;
             else
             { // a new code block
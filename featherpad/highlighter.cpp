@@ -19,44 +19,43 @@
 
 #include "highlighter.h"
 #include <QTextDocument>
+#include <QTextLayout>
+#include <string.h> // memset
 
-Q_DECLARE_METATYPE(QTextBlock)
+#define SLICE_DURATION 20 // in ms
+#define LAZY_MARGIN 1000 // in blocks
+#define CHECKPOINT_INTERVAL 256 // in blocks
+#define SCAN_DELAY 300 // in ms
+#define TOKEN_CLASS_PROPERTY QTextFormat::UserProperty
 
 namespace FeatherPad {
 
-TextBlockData::~TextBlockData()
+// Prepare the data for a new highlighting of its block.
+// The bracket lists keep their capacities.
+void TextBlockData::reset()
 {
-    while (!allParentheses.isEmpty())
-    {
-        ParenthesisInfo *info = allParentheses.at (0);
-        allParentheses.remove (0);
-        delete info;
-    }
-    while (!allBraces.isEmpty())
-    {
-        BraceInfo *info = allBraces.at (0);
-        allBraces.remove(0);
-        delete info;
-    }
-    while (!allBrackets.isEmpty())
-    {
-        BracketInfo *info = allBrackets.at (0);
-        allBrackets.remove(0);
-        delete info;
-    }
+    allParentheses.clear();
+    allBraces.clear();
+    allBrackets.clear();
+    label.clear();
+    Highlighted = false;
+    Property = false;
+    Deferred = false;
+    OpenNests = 0;
+    OpenQuotes.clear();
 }
 /*************************/
-QVector<ParenthesisInfo *> TextBlockData::parentheses() const
+const TextBlockData::ParenthesisList &TextBlockData::parentheses() const
 {
     return allParentheses;
 }
 /*************************/
-QVector<BraceInfo *> TextBlockData::braces() const
+const TextBlockData::BraceList &TextBlockData::braces() const
 {
     return allBraces;
 }
 /*************************/
-QVector<BracketInfo *> TextBlockData::brackets() const
+const TextBlockData::BracketList &TextBlockData::brackets() const
 {
     return allBrackets;
 }
@@ -76,6 +75,11 @@ bool TextBlockData::getProperty() const
     return Property;
 }
 /*************************/
+bool TextBlockData::isDeferred() const
+{
+    return Deferred;
+}
+/*************************/
 int TextBlockData::openNests() const
 {
     return OpenNests;
@@ -86,38 +90,29 @@ QSet<int> TextBlockData::openQuotes() const
     return OpenQuotes;
 }
 /*************************/
-void TextBlockData::insertInfo (ParenthesisInfo *info)
+void TextBlockData::insertInfo (const ParenthesisInfo &info)
 {
-    int i = 0;
-    while (i < allParentheses.size()
-           && info->position > allParentheses.at (i)->position)
-    {
-        ++i;
-    }
+    int i = allParentheses.size();
+    while (i > 0 && info.position < allParentheses.at (i - 1).position)
+        --i;
 
     allParentheses.insert (i, info);
 }
 /*************************/
-void TextBlockData::insertInfo (BraceInfo *info)
+void TextBlockData::insertInfo (const BraceInfo &info)
 {
-    int i = 0;
-    while (i < allBraces.size()
-           && info->position > allBraces.at (i)->position)
-    {
-        ++i;
-    }
+    int i = allBraces.size();
+    while (i > 0 && info.position < allBraces.at (i - 1).position)
+        --i;
 
     allBraces.insert (i, info);
 }
 /*************************/
-void TextBlockData::insertInfo (BracketInfo *info)
+void TextBlockData::insertInfo (const BracketInfo &info)
 {
-    int i = 0;
-    while (i < allBrackets.size()
-           && info->position > allBrackets.at (i)->position)
-    {
-        ++i;
-    }
+    int i = allBrackets.size();
+    while (i > 0 && info.position < allBrackets.at (i - 1).position)
+        --i;
 
     allBrackets.insert (i, info);
 }
@@ -137,6 +132,11 @@ void TextBlockData::setProperty (bool p)
     Property = p;
 }
 /*************************/
+void TextBlockData::setDeferred (bool deferred)
+{
+    Deferred = deferred;
+}
+/*************************/
 void TextBlockData::insertNestInfo (int nests)
 {
     OpenNests = nests;
@@ -153,8 +153,40 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
                           bool darkColorScheme,
                           bool showWhiteSpace, bool showEndings) : QSyntaxHighlighter (parent)
 {
+    deferredBlock = forcedBlock = -1;
+    hereDocBlockCount = 0;
+    spanGeneration = 0;
+    lazy = false;
+    keptFirst = keptLast = -1;
+    scanned = 0;
+    stateOnly = false;
+    resumeTimer = new QTimer (this);
+    resumeTimer->setSingleShot (true);
+    connect (resumeTimer, &QTimer::timeout, this, &Highlighter::resumeHighlighting);
+    scanTimer = new QTimer (this);
+    scanTimer->setSingleShot (true);
+    connect (scanTimer, &QTimer::timeout, this, &Highlighter::scanStates);
+    connect (parent, &QTextDocument::contentsChange, this, &Highlighter::onContentsChange);
+
     if (lang.isEmpty()) return;
 
+    if (lang == "sh" || lang == "makefile" || lang == "cmake")
+    {
+        /* Kate uses something like "<<(?:\\s*)([\\\\]{,1}[^\\s]+)" */
+        hereDocDelimExp = QRegExp ("<<(?:\\s*)([\\\\]{,1}[A-Za-z0-9_]+)|<<(?:\\s*)(\'[A-Za-z0-9_]+\')|<<(?:\\s*)(\"[A-Za-z0-9_]+\")");
+        hereDocCommentExp = QRegExp ("^#.*|\\s+#.*");
+    }
+    else if (lang == "perl") // without space after "<<" and with ";" at the end
+    {
+        hereDocDelimExp = QRegExp ("<<([A-Za-z0-9_]+)(?:;)|<<(\'[A-Za-z0-9_]+\')(?:;)|<<(\"[A-Za-z0-9_]+\")(?:;)");
+        hereDocCommentExp = QRegExp ("#.*");
+    }
+    else if (lang == "ruby")
+    {
+        hereDocDelimExp = QRegExp ("<<(?:-|~){,1}([A-Za-z0-9_]+)|<<(\'[A-Za-z0-9_]+\')|<<(\"[A-Za-z0-9_]+\")");
+        hereDocCommentExp = QRegExp ("#.*");
+    }
+
     if (showWhiteSpace || showEndings)
     {
         QTextOption opt =  document()->defaultTextOption();
@@ -171,14 +203,12 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
         document()->setDefaultTextOption (opt);
     }
 
-    /* for highlighting next block inside highlightBlock() when needed */
-    qRegisterMetaType<QTextBlock>();
-
     startCursor = start;
     endCursor = end;
     progLan = lang;
 
     quoteMark = QRegExp ("\""); // the standard quote mark
+    quoteChar = '\"';
 
     HighlightingRule rule;
     QColor Faded, translucent;
@@ -226,6 +256,16 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
     quoteEndExpression = QRegExp ("([^\"'])\"");*/
     JSRegexFormat.setForeground (DarkRed);
 
+    /* the token classes should be set before formats are copied */
+    commentFormat.setProperty (TOKEN_CLASS_PROPERTY, commentClass);
+    urlFormat.setProperty (TOKEN_CLASS_PROPERTY, urlClass);
+    quoteFormat.setProperty (TOKEN_CLASS_PROPERTY, quoteClass);
+    altQuoteFormat.setProperty (TOKEN_CLASS_PROPERTY, altQuoteClass);
+    blockQuoteFormat.setProperty (TOKEN_CLASS_PROPERTY, blockQuoteClass);
+    codeBlockFormat.setProperty (TOKEN_CLASS_PROPERTY, quoteClass); // the same as `...`
+    JSRegexFormat.setProperty (TOKEN_CLASS_PROPERTY, JSRegexClass);
+    neutralFormat.setProperty (TOKEN_CLASS_PROPERTY, neutralClass);
+
     /*************
      * Functions *
      *************/
@@ -687,6 +727,7 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
     else if (progLan == "markdown")
     {
         quoteMark = QRegExp ("`"); // inline code is almost like a single-line quote
+        quoteChar = '`';
         blockQuoteFormat.setForeground (DarkGreen);
         codeBlockFormat.setForeground (DarkRed);
         QTextCharFormat markdownFormat;
@@ -702,6 +743,7 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
         */
 
         /* italic */
+        markdownFormat.setProperty (TOKEN_CLASS_PROPERTY, emphasisClass);
         markdownFormat.setFontItalic (true);
         rule.pattern = QRegExp ("(^|\\s)\\*[^\\*_]+\\*(?!(\\w|\\*))"
                                 "|"
@@ -764,6 +806,7 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
            ![Image][1]
            [1]: /path/to/image "alt text"
         */
+        markdownFormat.clearProperty (TOKEN_CLASS_PROPERTY);
         markdownFormat.setFontWeight (QFont::Normal);
         markdownFormat.setForeground (Violet);
         markdownFormat.setFontUnderline (true);
@@ -779,6 +822,7 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
         highlightingRules.append (rule);
 
         /* headings */
+        markdownFormat.setProperty (TOKEN_CLASS_PROPERTY, emphasisClass);
         markdownFormat.setFontWeight (QFont::Bold);
         markdownFormat.setForeground (Blue);
         rule.pattern = QRegExp ("^#+\\s+.*");
@@ -890,11 +934,29 @@ Highlighter::Highlighter (QTextDocument *parent, const QString& lang,
         commentStartExpression = QRegExp ("\"\"\"|\'\'\'");
         commentEndExpression = commentStartExpression;
     }
-    else if (progLan == "xml" || progLan == "html")
+    else if (progLan == "xml")
     {
         commentStartExpression = QRegExp ("<!--");
         commentEndExpression = QRegExp ("-->");
     }
+    else if (progLan == "html")
+    {
+        htmlBraStartExp = QRegExp ("<(?!\\!)/{,1}[A-Za-z0-9_\\-]+");
+        htmlStyleExp = QRegExp ("<(style|STYLE)$|<(style|STYLE)\\s+[^>]*");
+        htmlQuoteExp = QRegExp ("\"|\'");
+        htmlAttExp = QRegExp ("[A-Za-z0-9_\\-]+(?=\\s*\\=)");
+        htmlCSSStartExp = QRegExp ("<(style|STYLE)>|<(style|STYLE)\\s+[^>]*>");
+        htmlCSSEndExp = QRegExp ("</(style|STYLE)\\s*>");
+        htmlJSStartExp = QRegExp ("<(script|SCRIPT)\\s+(language|LANGUAGE)\\s*\\=\\s*\"\\s*JavaScript\\s*\"[A-Za-z0-9_\\.\"\\s\\=]*>");
+        htmlJSEndExp = QRegExp ("</(script|SCRIPT)\\s*>");
+        /* CSS and JavaScript comments are switched to temporarily */
+        htmlCommentStartExp = QRegExp ("<!--");
+        htmlCommentEndExp = QRegExp ("-->");
+        cCommentStartExp = QRegExp ("/\\*");
+        cCommentEndExp = QRegExp ("\\*/");
+        commentStartExpression = htmlCommentStartExp;
+        commentEndExpression = htmlCommentEndExp;
+    }
     else if (progLan == "perl")
     {
         commentStartExpression = QRegExp ("^=[A-Za-z0-9_]+($|\\s+)");
@@ -928,43 +990,68 @@ bool Highlighter::isEscapedChar (const QString &text, const int pos)
 {
     if (pos < 1) return false;
     int i = 0;
-    while (pos - i >= 1
-           && pos - i - 1 == QRegExp ("\\\\").indexIn (text, pos - i - 1))
-    {
+    while (pos - i >= 1 && text.at (pos - i - 1) == '\\')
         ++i;
-    }
     if (i % 2 != 0)
         return true;
     return false;
 }
 /*************************/
+// Checks if the quotation mark at "pos" surrounds a here-doc delimiter,
+// i.e., if it comes after "<<" or ends a delimiter like "<<'EOF".
+static bool isHereDocDelimQuote (const QString &text, const int pos)
+{
+    int i = pos;
+    while (i > 0 && text.at (i - 1).isSpace())
+        --i;
+    if (i >= 2 && text.at (i - 1) == '<' && text.at (i - 2) == '<')
+        return true;
+
+    i = pos;
+    while (i > 0)
+    {
+        QChar c = text.at (i - 1);
+        if (!(c >= 'A' && c <= 'Z') && !(c >= 'a' && c <= 'z')
+            && !(c >= '0' && c <= '9') && c != '_')
+        {
+            break;
+        }
+        --i;
+    }
+    if (i == pos || i == 0)
+        return false;
+    QChar q = text.at (i - 1);
+    if (q != '\'' && q != '\"')
+        return false;
+    --i;
+    while (i > 0 && text.at (i - 1).isSpace())
+        --i;
+    return (i >= 2 && text.at (i - 1) == '<' && text.at (i - 2) == '<');
+}
+/*************************/
 // Check if a start or end quotation mark (positioned at "pos") is escaped.
 // If "skipCommandSign" is true (only for SH), start double quotes are escaped before "$(".
 bool Highlighter::isEscapedQuote (const QString &text, const int pos, bool isStartQuote,
                                   bool skipCommandSign)
 {
-    if (pos < 0) return false;
+    if (pos < 0 || pos >= text.length()) return false;
 
     if (progLan == "html" || progLan == "xml")
         return false;
 
-    if (pos != quoteMark.indexIn (text, pos)
-        && (progLan == "markdown" || pos != QRegExp ("\'").indexIn (text, pos)))
+    QChar c = text.at (pos);
+    if (c != quoteChar
+        && (progLan == "markdown" || c != '\''))
     {
         return false;
     }
 
     /* check if the quote surrounds a here-doc delimiter */
     if ((currentBlockState() >= endState || currentBlockState() < -1)
-        && currentBlockState() % 2 == 0)
+        && currentBlockState() % 2 == 0
+        && isHereDocDelimQuote (text, pos))
     {
-        QRegExp delimPart = QRegExp ("<<\\s*");
-        QRegExp delimPart1 = QRegExp ("<<(?:\\s*)(\'[A-Za-z0-9_]+)|<<(?:\\s*)(\"[A-Za-z0-9_]+)");
-        if (text.lastIndexOf (delimPart, pos) == pos - delimPart.matchedLength()
-            || text.lastIndexOf (delimPart1, pos) == pos - delimPart1.matchedLength())
-        {
-            return true;
-        }
+        return true;
     }
 
     /* escaped start quotes are just for Bash, Perl and markdown */
@@ -975,28 +1062,31 @@ bool Highlighter::isEscapedQuote (const QString &text, const int pos, bool isSta
         return false;
     }
 
-    if (isStartQuote && skipCommandSign && pos == quoteMark.indexIn (text, pos)
-        && QRegExp("[^\"]*\\$\\(").indexIn (text, pos) == pos + 1)
-    {
-        return true;
+    if (isStartQuote && skipCommandSign && c == quoteChar)
+    { // "$(" before the next double quote
+        for (int i = pos + 1; i < text.length() && text.at (i) != '\"'; ++i)
+        {
+            if (text.at (i) == '$' && i + 1 < text.length() && text.at (i + 1) == '(')
+                return true;
+        }
     }
 
     /* in Perl, $' has a (deprecated?) meaning */
     if (isStartQuote // otherwise undetectable
-        && progLan == "perl" && pos >= 1 && pos - 1 == QRegExp ("\\$").indexIn (text, pos - 1))
+        && progLan == "perl" && pos >= 1 && text.at (pos - 1) == '$')
     {
         return true;
     }
 
     int i = 0;
-    while (pos - i >= 1 && pos - i - 1 == QRegExp ("\\\\").indexIn (text, pos - i - 1))
+    while (pos - i >= 1 && text.at (pos - i - 1) == '\\')
         ++i;
     /* only an odd number of backslashes means that the quote is escaped */
     if (
         i % 2 != 0
             /* for perl, only double quote can be escaped? */
         && (/*(progLan == "perl"
-             && pos == quoteMark.indexIn (text, pos)) ||*/
+             && c == quoteChar) ||*/
             /* for these languages, both single and double quotes can be escaped */
             progLan == "cpp" || progLan == "c"
             || progLan == "python"
@@ -1006,7 +1096,7 @@ bool Highlighter::isEscapedQuote (const QString &text, const int pos, bool isSta
             || progLan == "markdown"
             /* however, in Bash, single quote can be escaped only at start */
             || ((progLan == "sh" || progLan == "makefile" || progLan == "cmake")
-                && (isStartQuote || pos == quoteMark.indexIn (text, pos))))
+                && (isStartQuote || c == quoteChar)))
        )
     {
         return true;
@@ -1015,14 +1105,33 @@ bool Highlighter::isEscapedQuote (const QString &text, const int pos, bool isSta
     return false;
 }
 /*************************/
+// Returns the position of the next "first" or "second" character, starting from "from".
+static inline int nextQuote (const QString &text, int from, const QChar first, const QChar second)
+{
+    const int l = text.length();
+    const QChar *chars = text.constData();
+    for (int i = qMax (from, 0); i < l; ++i)
+    {
+        if (chars[i] == first || chars[i] == second)
+            return i;
+    }
+    return -1;
+}
+/*************************/
 // Checks if a character is inside quotation marks, considering the language
 // (should be used with care because it gives correct results only in special places).
 // If "skipCommandSign" is true (only for SH), start double quotes are escaped before "$(".
+// The line is scanned only once and the quotes are kept in a span table until
+// token classes or the block state change.
 bool Highlighter::isQuoted (const QString &text, const int index,
                             bool skipCommandSign)
 {
     if (index < 0) return false;
 
+    SpanTable &spans = quoteSpans[skipCommandSign ? 1 : 0];
+    if (spans.isValid (spanGeneration, currentBlockState(), text.length()))
+        return spans.isInside (index);
+
     bool res = false;
     int pos = -1;
     int N;
@@ -1035,11 +1144,9 @@ bool Highlighter::isQuoted (const QString &text, const int index,
     {
         mixedQuotes = true;
     }
-    QRegExp quoteExpression;
-    if (mixedQuotes)
-        quoteExpression = QRegExp ("\"|\'");
-    else
-        quoteExpression = quoteMark;
+    /* the quotation marks that are searched for */
+    QChar first = quoteChar;
+    QChar second = mixedQuotes ? QChar ('\'') : quoteChar;
     int prevState = previousBlockState();
     if ((prevState < doubleQuoteState
          || prevState > SH_MixedSingleQuoteState)
@@ -1059,7 +1166,7 @@ bool Highlighter::isQuoted (const QString &text, const int index,
                 || prevState == SH_MixedDoubleQuoteState
                 || prevState == htmlStyleDoubleQuoteState)
             {
-                quoteExpression = quoteMark;
+                second = quoteChar;
                 if (skipCommandSign)
                 {
                     if (QRegExp("[^\"]*\\$\\(").indexIn (text, 0) == 0)
@@ -1086,14 +1193,21 @@ bool Highlighter::isQuoted (const QString &text, const int index,
                 }
             }
             else
-                quoteExpression = QRegExp ("\'");
+                first = second = '\'';
         }
     }
 
-    while ((pos = quoteExpression.indexIn (text, pos + 1)) >= 0)
+    spans.generation = spanGeneration;
+    spans.key = currentBlockState();
+    spans.length = text.length();
+    spans.initial = N;
+    spans.startsInside = res;
+    spans.toggles.clear();
+
+    while ((pos = nextQuote (text, pos + 1, first, second)) >= 0)
     {
         /* skip formatted comments */
-        if (format (pos) == commentFormat) continue;
+        if (tokenClass (pos) == commentClass) continue;
 
         ++N;
         if ((N % 2 == 0 // an escaped end quote...
@@ -1105,32 +1219,26 @@ bool Highlighter::isQuoted (const QString &text, const int index,
             continue;
         }
 
-        if (index < pos)
-        {
-            if (N % 2 == 0) res = true;
-            else res = false;
-            break;
-        }
-
-        /* "pos" might be negative next time */
-        if (N % 2 == 0) res = false;
-        else res = true;
+        spans.toggles.append (pos);
 
         if (mixedQuotes)
         {
             if (N % 2 != 0)
             { // each quote neutralizes the other until it's closed
-                if (pos == quoteMark.indexIn (text, pos))
-                    quoteExpression = quoteMark;
+                if (text.at (pos) == quoteChar)
+                    first = second = quoteChar;
                 else
-                    quoteExpression = QRegExp ("\'");
+                    first = second = '\'';
             }
             else
-                quoteExpression = QRegExp ("\"|\'");
+            {
+                first = quoteChar;
+                second = '\'';
+            }
         }
     }
 
-    return res;
+    return spans.isInside (index);
 }
 /*************************/
 // Checks if a start quote is inside a multiline comment (may give an incorrect result
@@ -1149,6 +1257,12 @@ bool Highlighter::isMLCommented (const QString &text, const int index, int comSt
     if (prevState == nextLineCommentState)
         return true; // see singleLineComment()
 
+    /* all multiline comments have more than one character and a comment sign
+       at "index - 1" is ignored for knowing if double slashes follow an
+       asterisk, for example, because QRegExp lacks "lookbehind" */
+    if (commentSpans.isValid (spanGeneration, comState, text.length()))
+        return commentSpans.isInside (index - 2);
+
     bool res = false;
     int pos = -1;
     int N;
@@ -1165,41 +1279,32 @@ bool Highlighter::isMLCommented (const QString &text, const int index, int comSt
         commentExpression = commentEndExpression;
     }
 
+    commentSpans.generation = spanGeneration;
+    commentSpans.key = comState;
+    commentSpans.length = text.length();
+    commentSpans.initial = N;
+    commentSpans.startsInside = res;
+    commentSpans.toggles.clear();
+
     while ((pos = commentExpression.indexIn (text, pos + 1)) >= 0)
     {
         /* skip formatted quotations */
-        if (format (pos) == quoteFormat
-            || format (pos) == altQuoteFormat)
+        if (tokenClass (pos) == quoteClass
+            || tokenClass (pos) == altQuoteClass)
         {
             continue;
         }
 
         ++N;
-
-        if (index <= pos + 1) /* all multiline comments have more than
-                                 one character and this trick is needed
-                                 for knowing if double slashes follow an
-                                 asterisk, for example, because QRegExp
-                                 lacks "lookbehind" */
-        {
-            if (N % 2 == 0) res = true;
-            else res = false;
-            break;
-        }
+        commentSpans.toggles.append (pos);
 
         if (N % 2 != 0)
-        {
             commentExpression = commentEndExpression;
-            res = true;
-        }
         else
-        {
             commentExpression = commentStartExpression;
-            res = false;
-        }
     }
 
-    return res;
+    return commentSpans.isInside (index - 2);
 }
 /*************************/
 // This handles multiline python comments separately because they
@@ -1230,12 +1335,12 @@ void Highlighter::pythonMLComment (const QString &text, const int indx)
     {
         index = commentStartExpression.indexIn (text, indx);
 
-        while (format (index) == quoteFormat
-               || format (index) == altQuoteFormat)
+        while (tokenClass (index) == quoteClass
+               || tokenClass (index) == altQuoteClass)
         {
             index = commentStartExpression.indexIn (text, index + 3);
         }
-        while (format (index) == commentFormat)
+        while (tokenClass (index) == commentClass)
             index = commentStartExpression.indexIn (text, index + 3);
 
         /* if the comment start is found... */
@@ -1331,7 +1436,7 @@ void Highlighter::pythonMLComment (const QString &text, const int indx)
         while ((pIndex = str.indexOf (notePattern, indx)) > -1)
         {
             int ml = notePattern.matchedLength();
-            if (format (pIndex) != urlFormat)
+            if (tokenClass (pIndex) != urlClass)
               setFormat (pIndex + index, ml, noteFormat);
             indx = indx + ml;
         }
@@ -1339,12 +1444,12 @@ void Highlighter::pythonMLComment (const QString &text, const int indx)
         /* the next quote may be different */
         commentStartExpression = QRegExp ("\"\"\"|\'\'\'");
         index = commentStartExpression.indexIn (text, index + quoteLength);
-        while (format (index) == quoteFormat
-               || format (index) == altQuoteFormat)
+        while (tokenClass (index) == quoteClass
+               || tokenClass (index) == altQuoteClass)
         {
             index = commentStartExpression.indexIn (text, index + 3);
         }
-        while (format (index) == commentFormat)
+        while (tokenClass (index) == commentClass)
             index = commentStartExpression.indexIn (text, index + 3);
     }
 }
@@ -1373,6 +1478,7 @@ int Highlighter::cssHighlighter (const QString &text, bool mainFormatting, const
     QTextCharFormat cssValueFormat;
     cssValueFormat.setFontItalic (true);
     cssValueFormat.setForeground (Verda);
+    cssValueFormat.setProperty (TOKEN_CLASS_PROPERTY, cssValueClass);
 
     QTextCharFormat numFormat;
     numFormat.setFontItalic (true);
@@ -1381,6 +1487,7 @@ int Highlighter::cssHighlighter (const QString &text, bool mainFormatting, const
     QTextCharFormat cssErrorFormat;
     cssErrorFormat.setFontUnderline (true);
     cssErrorFormat.setForeground (Red);
+    cssErrorFormat.setProperty (TOKEN_CLASS_PROPERTY, cssErrorClass);
 
     int prevState = previousBlockState();
     if (index > 0
@@ -1465,7 +1572,7 @@ int Highlighter::cssHighlighter (const QString &text, bool mainFormatting, const
         index = cssStartExpression.indexIn (text, start);
         if (index > -1)
         {
-            while (format (index) != cssErrorFormat)
+            while (tokenClass (index) != cssErrorClass)
             {
                 index = cssStartExpression.indexIn (text, index + 1);
                 if (index == -1) break;
@@ -1519,7 +1626,7 @@ int Highlighter::cssHighlighter (const QString &text, bool mainFormatting, const
         if (index > -1)
         {
             if (!mainFormatting) break; // there's no cssErrorFormat
-            while (format (index) != cssErrorFormat)
+            while (tokenClass (index) != cssErrorClass)
             {
                 index = cssStartExpression.indexIn (text, index + 1);
                 if (index == -1) break;
@@ -1543,8 +1650,8 @@ int Highlighter::cssHighlighter (const QString &text, bool mainFormatting, const
         while (indxTmp >= 0)
         {
             int length = expression.matchedLength();
-            if (/*format (indxTmp) == cssValueFormat // should be a value
-                    &&*/ format (indxTmp) != cssErrorFormat) // not an error
+            if (/*tokenClass (indxTmp) == cssValueClass // should be a value
+                    &&*/ tokenClass (indxTmp) != cssErrorClass) // not an error
             {
                 setFormat (indxTmp, length, cssColorFormat);
             }
@@ -1561,8 +1668,8 @@ int Highlighter::cssHighlighter (const QString &text, bool mainFormatting, const
         while (indxTmp >= 0)
         {
             int length = expression.matchedLength();
-            if (format (indxTmp) != cssValueFormat
-                    && format (indxTmp) != cssErrorFormat)
+            if (tokenClass (indxTmp) != cssValueClass
+                    && tokenClass (indxTmp) != cssErrorClass)
             {
                 if (text.at (indxTmp) == ';')
                 {
@@ -1624,7 +1731,7 @@ void Highlighter::singleLineComment (const QString &text, const int start)
                 while ((pIndex = str.indexOf (notePattern, indx)) > -1)
                 {
                     int ml = notePattern.matchedLength();
-                    if (format (pIndex) != urlFormat)
+                    if (tokenClass (pIndex) != urlClass)
                       setFormat (pIndex + startIndex, ml, noteFormat);
                     indx = indx + ml;
                 }
@@ -1674,11 +1781,11 @@ void Highlighter::multiLineComment (const QString &text,
     {
         startIndex = commentStartExp.indexIn (text, startIndex);
         /* skip single-line comments */
-        if (format (startIndex) == commentFormat || format (startIndex) == urlFormat)
+        if (tokenClass (startIndex) == commentClass || tokenClass (startIndex) == urlClass)
             startIndex = -1;
         /* skip quotations (usually all formatted to this point) */
-        while (format (startIndex) == quoteFormat
-               || format (startIndex) == altQuoteFormat)
+        while (tokenClass (startIndex) == quoteClass
+               || tokenClass (startIndex) == altQuoteClass)
         {
             startIndex = commentStartExp.indexIn (text, startIndex + 1);
         }
@@ -1734,8 +1841,8 @@ void Highlighter::multiLineComment (const QString &text,
                                               startIndex + commentStartExp.matchedLength());
 
         /* skip quotations */
-        while (format (endIndex) == quoteFormat
-               || format (endIndex) == altQuoteFormat)
+        while (tokenClass (endIndex) == quoteClass
+               || tokenClass (endIndex) == altQuoteClass)
         {
             endIndex = commentEndExp.indexIn (text, endIndex + 1);
         }
@@ -1748,7 +1855,7 @@ void Highlighter::multiLineComment (const QString &text,
             badIndex = endIndex + 1;
             for (int i = badIndex; i < text.length(); ++i)
             {
-                if (format (i) == commentFormat || format (i) == urlFormat)
+                if (tokenClass (i) == commentClass || tokenClass (i) == urlClass)
                     setFormat (i, 1, neutralFormat);
             }
         }
@@ -1796,7 +1903,7 @@ void Highlighter::multiLineComment (const QString &text,
             while ((pIndex = str.indexOf (notePattern, indx)) > -1)
             {
                 int ml = notePattern.matchedLength();
-                if (format (pIndex) != urlFormat)
+                if (tokenClass (pIndex) != urlClass)
                     setFormat (pIndex + startIndex, ml, noteFormat);
                 indx = indx + ml;
             }
@@ -1813,8 +1920,8 @@ void Highlighter::multiLineComment (const QString &text,
                 {
                     QRegExp expression (rule.pattern);
                     int INDX = expression.indexIn (text, badIndex);
-                    while (format (INDX) == quoteFormat
-                           || format (INDX) == altQuoteFormat
+                    while (tokenClass (INDX) == quoteClass
+                           || tokenClass (INDX) == altQuoteClass
                            || isMLCommented (text, INDX, commState))
                     {
                         INDX = expression.indexIn (text, INDX + 1);
@@ -1827,10 +1934,10 @@ void Highlighter::multiLineComment (const QString &text,
         }
 
         /* skip single-line comments and quotations again */
-        if (format (startIndex) == commentFormat || format (startIndex) == urlFormat)
+        if (tokenClass (startIndex) == commentClass || tokenClass (startIndex) == urlClass)
             startIndex = -1;
-        while (format (startIndex) == quoteFormat
-               || format (startIndex) == altQuoteFormat)
+        while (tokenClass (startIndex) == quoteClass
+               || tokenClass (startIndex) == altQuoteClass)
         {
             startIndex = commentStartExp.indexIn (text, startIndex + 1);
         }
@@ -1839,7 +1946,7 @@ void Highlighter::multiLineComment (const QString &text,
     /* reset the block state if this line created a next-line comment
        whose starting single-line comment sign is commented out now */
     if (currentBlockState() == nextLineCommentState
-        && format (text.size() - 1) != commentFormat && format (text.size() - 1) != urlFormat)
+        && tokenClass (text.size() - 1) != commentClass && tokenClass (text.size() - 1) != urlClass)
     {
         setCurrentBlockState (0);
     }
@@ -1896,7 +2003,7 @@ void Highlighter::multiLineQuote (const QString &text, const int start, int comS
         {
             index = quoteExpression.indexIn (text, index + 1);
         }
-        while (format (index) == commentFormat || format (index) == urlFormat) // single-line and Python
+        while (tokenClass (index) == commentClass || tokenClass (index) == urlClass) // single-line and Python
             index = quoteExpression.indexIn (text, index + 1);
 
         /* if the start quote is found... */
@@ -2015,42 +2122,68 @@ void Highlighter::multiLineQuote (const QString &text, const int start, int comS
         {
             index = quoteExpression.indexIn (text, index + 1);
         }
-        while (format (index) == commentFormat || format (index) == urlFormat)
+        while (tokenClass (index) == commentClass || tokenClass (index) == urlClass)
             index = quoteExpression.indexIn (text, index + 1);
     }
 }
 /*************************/
+// Besides formatting, set the token classes of the characters.
+void Highlighter::setFormat (int start, int count, const QTextCharFormat &format)
+{
+    if (!stateOnly)
+        QSyntaxHighlighter::setFormat (start, count, format);
+    if (start < 0 || start >= tokenClasses.size())
+        return;
+    count = qMin (count, tokenClasses.size() - start);
+    if (count > 0)
+    {
+        uchar tc = static_cast<uchar>(format.intProperty (TOKEN_CLASS_PROPERTY));
+        uchar *classes = tokenClasses.data() + start;
+        for (int i = 0; i < count; ++i)
+        {
+            if (classes[i] != tc)
+            { // the span tables may not be valid anymore
+                ++spanGeneration;
+                memset (classes + i, tc, count - i);
+                break;
+            }
+        }
+    }
+}
+/*************************/
 // Generalized form of setFormat(), where "oldFormat" shouldn't be reformatted.
+// "oldFormat" should have a token class (like neutralFormat).
 void Highlighter::setFormatWithoutOverwrite (int start,
                                              int count,
                                              const QTextCharFormat &newFormat,
                                              const QTextCharFormat &oldFormat)
 {
+    int oldClass = oldFormat.intProperty (TOKEN_CLASS_PROPERTY);
     int index = start; // always >= 0
     int indx;
     while (index < start + count)
     {
-        QTextCharFormat fi = format (index);
+        int tc = tokenClass (index);
         while (index < start + count
-               && (fi == oldFormat
+               && (tc == oldClass
                    /* skip comments and quotes */
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == quoteFormat || fi == altQuoteFormat))
+                   || tc == commentClass || tc == urlClass
+                   || tc == quoteClass || tc == altQuoteClass))
         {
             ++ index;
-            fi = format (index);
+            tc = tokenClass (index);
         }
         if (index < start + count)
         {
             indx = index;
-            fi = format (indx);
+            tc = tokenClass (indx);
             while (indx < start + count
-                   && fi != oldFormat
-                   && fi != commentFormat && fi != urlFormat
-                   && fi != quoteFormat && fi != altQuoteFormat)
+                   && tc != oldClass
+                   && tc != commentClass && tc != urlClass
+                   && tc != quoteClass && tc != altQuoteClass)
             {
                 ++ indx;
-                fi = format (indx);
+                tc = tokenClass (indx);
             }
             setFormat (index, indx - index , newFormat);
             index = indx;
@@ -2076,10 +2209,10 @@ void Highlighter::xmlQuotes (const QString &text)
     {
         index = quoteExpression.indexIn (text);
         /* skip all comments */
-        while (format (index) == commentFormat || format (index) == urlFormat)
+        while (tokenClass (index) == commentClass || tokenClass (index) == urlClass)
             index = quoteExpression.indexIn (text, index + 1);
         /* skip all values (that are formatted by multiLineComment()) */
-        while (format (index) == neutralFormat)
+        while (tokenClass (index) == neutralClass)
             index = quoteExpression.indexIn (text, index + 1);
 
         /* if the start quote is found... */
@@ -2156,10 +2289,10 @@ void Highlighter::xmlQuotes (const QString &text)
         index = quoteExpression.indexIn (text, index + quoteLength);
 
         /* skip all values */
-        while (format (index) == neutralFormat)
+        while (tokenClass (index) == neutralClass)
             index = quoteExpression.indexIn (text, index + 1);
         /* skip all comments */
-        while (format (index) == commentFormat || format (index) == urlFormat)
+        while (tokenClass (index) == commentClass || tokenClass (index) == urlClass)
             index = quoteExpression.indexIn (text, index + 1);
     }
 }
@@ -2178,21 +2311,10 @@ bool Highlighter::isHereDocument (const QString &text)
     QTextCharFormat delimFormat = blockFormat;
     delimFormat.setFontWeight (QFont::Bold);
     QString delimStr;
-    /* Kate uses something like "<<(?:\\s*)([\\\\]{,1}[^\\s]+)" */
-    QRegExp delim;
-    if (progLan == "sh" || progLan == "makefile" || progLan == "cmake")
-        delim = QRegExp ("<<(?:\\s*)([\\\\]{,1}[A-Za-z0-9_]+)|<<(?:\\s*)(\'[A-Za-z0-9_]+\')|<<(?:\\s*)(\"[A-Za-z0-9_]+\")");
-    else if (progLan == "perl") // without space after "<<" and with ";" at the end
-        delim = QRegExp ("<<([A-Za-z0-9_]+)(?:;)|<<(\'[A-Za-z0-9_]+\')(?:;)|<<(\"[A-Za-z0-9_]+\")(?:;)");
-    else if (progLan == "ruby")
-        delim = QRegExp ("<<(?:-|~){,1}([A-Za-z0-9_]+)|<<(\'[A-Za-z0-9_]+\')|<<(\"[A-Za-z0-9_]+\")");
-    else // FIXME: No language.
-        delim = QRegExp ("<<([A-Za-z0-9_]+)|<<(\'[A-Za-z0-9_]+\')|<<(\"[A-Za-z0-9_]+\")");
-    QRegExp comment = (progLan == "sh" || progLan == "makefile" || progLan == "cmake")
-                        ? QRegExp ("^#.*|\\s+#.*")
-                        : QRegExp ("#.*");
-    int insideCommentPos = comment.indexIn (text);
+    QRegExp &delim = hereDocDelimExp;
+    int insideCommentPos = hereDocCommentExp.indexIn (text);
     int pos = 0;
+    int bn = currentBlock().blockNumber();
 
     /* format the start delimiter */
     int prevState = previousBlockState();
@@ -2241,9 +2363,17 @@ bool Highlighter::isHereDocument (const QString &text)
             data->insertInfo (delimStr);
             setCurrentBlockUserData (data);
 
+            HereDocRegion &region = hereDocs[bn];
+            if (region.delimiter != delimStr)
+            {
+                region.delimiter = delimStr;
+                region.endBlock = -1;
+            }
+
             return false;
         }
     }
+    hereDocs.remove (bn); // not a start delimiter
 
     if (prevState >= endState || prevState < -1)
     {
@@ -2252,20 +2382,37 @@ bool Highlighter::isHereDocument (const QString &text)
         int l = 0;
         if (progLan == "perl" || progLan == "ruby")
         {
-            QRegExp r = QRegExp ("\\s*" + delimStr + "(?=(\\W+|$))");
-            if (r.indexIn (text) == 0)
-                l = r.matchedLength();
+            if (hereDocEndDelim != delimStr)
+            { // make the end expression only when the delimiter changes
+                hereDocEndDelim = delimStr;
+                hereDocEndExp = QRegExp ("\\s*" + delimStr + "(?=(\\W+|$))");
+            }
+            if (hereDocEndExp.indexIn (text) == 0)
+                l = hereDocEndExp.matchedLength();
         }
-        else if (text == delimStr
-                 || (text.startsWith (delimStr)
-                     && text.indexOf (QRegExp ("\\W+")) == delimStr.length()))
+        else if (text.startsWith (delimStr))
         {
-            l = delimStr.length();
+            if (text.length() == delimStr.length())
+                l = delimStr.length();
+            else
+            { // a non-word character should come after the delimiter
+                QChar ch = text.at (delimStr.length());
+                if (!ch.isLetterOrNumber() && !ch.isMark() && ch != '_')
+                    l = delimStr.length();
+            }
         }
         if (l > 0)
         {
             /* format the end delimiter */
             setFormat (0, l, delimFormat);
+            /* record the end of the here-doc */
+            QMap<int, HereDocRegion>::iterator it = hereDocs.lowerBound (bn);
+            if (it != hereDocs.begin())
+            {
+                --it;
+                if (it.value().delimiter == delimStr)
+                    it.value().endBlock = bn;
+            }
             return false;
         }
         else
@@ -2399,11 +2546,447 @@ void Highlighter::debControlFormatting (const QString &text)
     }
 }
 /*************************/
-// Start syntax highlighting!
+// The visible blocks are always highlighted but, when a change in a block state
+// should be propagated downward, off-screen blocks are highlighted only as long as
+// the current time slice lasts. After that, the rest of the propagation is deferred
+// by keeping the old state of the current block, which stops QSyntaxHighlighter
+// from going further. The deferred highlighting is resumed in resumeHighlighting().
+bool Highlighter::deferHighlighting()
+{
+    int bn = currentBlock().blockNumber();
+    if (bn <= forcedBlock
+        || (bn >= startCursor.blockNumber() && bn <= endCursor.blockNumber()))
+    {
+        return false;
+    }
+
+    if (lazy && !isNearView (bn))
+    { // the old state is kept and the scan will find the new one
+        TextBlockData *data = static_cast<TextBlockData *>(currentBlockUserData());
+        if (!data)
+        {
+            data = new TextBlockData;
+            setCurrentBlockUserData (data);
+        }
+        data->insertHighlightInfo (false);
+        data->setDeferred (true);
+        rescanFrom (currentBlock());
+        keepOldFormats();
+        return true;
+    }
+
+    if (!sliceTimer.isValid())
+    { // a new time slice starts here and ends with the current event
+        sliceTimer.start();
+        QTimer::singleShot (0, this, SLOT (endSlice()));
+        return false;
+    }
+    if (sliceTimer.elapsed() < SLICE_DURATION)
+        return false;
+
+    TextBlockData *data = static_cast<TextBlockData *>(currentBlockUserData());
+    if (!data)
+    {
+        data = new TextBlockData;
+        setCurrentBlockUserData (data);
+    }
+    data->insertHighlightInfo (false);
+    data->setDeferred (true);
+    deferFrom (bn);
+    keepOldFormats();
+    return true;
+}
+/*************************/
+// QSyntaxHighlighter has cleared the formats of the current block and would
+// remove its colors if it isn't highlighted. So, a deferred block is given its
+// old formats, which it keeps until it's highlighted again.
+void Highlighter::keepOldFormats()
+{
+    QTextLayout *layout = currentBlock().layout();
+    if (!layout) return;
+#if QT_VERSION >= 0x050600
+    const QVector<QTextLayout::FormatRange> formats = layout->formats();
+#else
+    const QList<QTextLayout::FormatRange> formats = layout->additionalFormats();
+#endif
+    for (const QTextLayout::FormatRange &r : formats)
+        setFormat (r.start, r.length, r.format);
+}
+/*************************/
+// Mark a block for being highlighted later (instead of being rehighlighted immediately).
+void Highlighter::deferBlock (const QTextBlock &block)
+{
+    if (!block.isValid()) return;
+    if (TextBlockData *data = static_cast<TextBlockData *>(block.userData()))
+    {
+        data->insertHighlightInfo (false);
+        data->setDeferred (true);
+    }
+    deferFrom (block.blockNumber());
+}
+/*************************/
+void Highlighter::deferFrom (int blockNumber)
+{
+    if (deferredBlock < 0 || blockNumber < deferredBlock)
+        deferredBlock = blockNumber;
+    if (!resumeTimer->isActive())
+        resumeTimer->start (0);
+}
+/*************************/
+void Highlighter::endSlice()
+{
+    sliceTimer.invalidate();
+}
+/*************************/
+// Highlight the deferred blocks in a new time slice and defer the rest again.
+// The propagation stops by itself as soon as a new block state is the same as
+// the old one because QSyntaxHighlighter doesn't go further in that case.
+void Highlighter::resumeHighlighting()
+{
+    if (deferredBlock < 0 || !document()) return;
+    int first = deferredBlock;
+    if (lazy) // far blocks will be highlighted when they come near the view
+    {
+        first = qMax (first, startCursor.blockNumber() - LAZY_MARGIN);
+        if (deferredBlock < first)
+            rescanFrom (document()->findBlockByNumber (deferredBlock));
+    }
+    QTextBlock block = document()->findBlockByNumber (first);
+    deferredBlock = -1;
+    sliceTimer.restart();
+    while (block.isValid())
+    {
+        if (lazy && !isNearView (block.blockNumber()))
+        {
+            rescanFrom (block);
+            break;
+        }
+        if (sliceTimer.elapsed() >= SLICE_DURATION)
+        {
+            deferFrom (block.blockNumber());
+            break;
+        }
+        TextBlockData *data = static_cast<TextBlockData *>(block.userData());
+        if (!data || data->isDeferred())
+            rehighlightBlock (block);
+        block = block.next();
+    }
+    sliceTimer.invalidate();
+}
+/*************************/
+// Highlight all deferred blocks up to the given block immediately.
+// This is needed before the visible blocks are formatted because
+// they should be highlighted based on the correct states.
+void Highlighter::highlightDeferred (int lastBlockNumber)
+{
+    if (!document()) return;
+    int first = deferredBlock;
+    if (lazy)
+    {
+        evictFarBlocks();
+        first = qMax (0, startCursor.blockNumber() - LAZY_MARGIN);
+        if (deferredBlock >= 0 && deferredBlock < first)
+            rescanFrom (document()->findBlockByNumber (deferredBlock));
+        /* resume from the nearest checkpoint if the states before the
+           viewport are known or will be known soon; otherwise, highlight
+           the viewport provisionally until the scan reaches it */
+        if (first <= knownStates() + LAZY_MARGIN)
+            first = resumeBlock (first).blockNumber();
+    }
+    if (first < 0 || first > lastBlockNumber)
+        return;
+    QTextBlock block = document()->findBlockByNumber (first);
+    deferredBlock = -1;
+    forcedBlock = lastBlockNumber;
+    while (block.isValid() && block.blockNumber() <= lastBlockNumber)
+    {
+        TextBlockData *data = static_cast<TextBlockData *>(block.userData());
+        if (!data || data->isDeferred())
+        {
+            rehighlightBlock (block);
+            if (lazy && block.blockNumber() > first)
+                dropScanData (block.previous());
+        }
+        block = block.next();
+    }
+    forcedBlock = -1;
+    /* the next blocks may have been deferred too */
+    if (block.isValid())
+        deferFrom (block.blockNumber());
+}
+/*************************/
+bool Highlighter::isNearView (int blockNumber) const
+{
+    return (blockNumber >= startCursor.blockNumber() - LAZY_MARGIN
+            && blockNumber <= endCursor.blockNumber() + LAZY_MARGIN);
+}
+/*************************/
+// In the lazy mode, remove the formats and data of the blocks that are far from
+// the viewport, so that the memory usage is bounded. The block states aren't
+// touched because they are the checkpoints from which scanning is resumed, and
+// the bracket index keeps the nesting changes of the blocks for bracket matching.
+void Highlighter::evictFarBlocks()
+{
+    int first = qMax (0, startCursor.blockNumber() - LAZY_MARGIN);
+    int last = endCursor.blockNumber() + LAZY_MARGIN;
+    if (keptFirst >= 0)
+    {
+        QTextBlock block = document()->findBlockByNumber (keptFirst);
+        while (block.isValid() && block.blockNumber() <= keptLast)
+        {
+            if (block.blockNumber() >= first && block.blockNumber() <= last)
+            { // jump over the blocks that are near the view
+                block = document()->findBlockByNumber (last + 1);
+                continue;
+            }
+            if (block.userData())
+            {
+                if (block.blockNumber() % CHECKPOINT_INTERVAL != 0) // not a checkpoint
+                    block.setUserData (nullptr); // deletes the data
+#if QT_VERSION >= 0x050600
+                block.layout()->clearFormats();
+#else
+                block.layout()->clearAdditionalFormats();
+#endif
+                document()->markContentsDirty (block.position(), block.length());
+            }
+            block = block.next();
+        }
+    }
+    keptFirst = first;
+    keptLast = last;
+}
+/*************************/
+// Returns the first block that should be highlighted for giving correct states
+// to the blocks from the given one on, i.e., the block after the nearest
+// checkpoint before it. A checkpoint is a block whose state is known (it comes
+// before knownStates()) and whose data is kept (for SH and here-docs).
+QTextBlock Highlighter::resumeBlock (int blockNumber) const
+{
+    QTextBlock block = document()->findBlockByNumber (qMin (blockNumber, knownStates()) - 1);
+    while (block.isValid())
+    {
+        TextBlockData *data = static_cast<TextBlockData *>(block.userData());
+        if (data && !data->isDeferred())
+            return block.next();
+        block = block.previous();
+    }
+    return document()->firstBlock();
+}
+/*************************/
+// In the lazy mode, the data of a far block isn't needed after the next block is
+// scanned, unless the block is a checkpoint. Its entry in the bracket index is kept.
+void Highlighter::dropScanData (QTextBlock block)
+{
+    if (!block.isValid() || !block.userData()) return;
+    const int bn = block.blockNumber();
+    if (bn % CHECKPOINT_INTERVAL == 0 || isNearView (bn)) return;
+    block.setUserData (nullptr); // deletes the data
+}
+/*************************/
+// In the lazy mode, gives a far block its data again (without formatting it)
+// by highlighting it from the nearest checkpoint before it. This is needed when
+// the bracket index finds a match in a block whose data has been removed.
+void Highlighter::restoreData (const QTextBlock &block)
+{
+    if (!lazy || !block.isValid() || block.userData()) return;
+    const int bn = block.blockNumber();
+    QTextBlock b = resumeBlock (bn);
+    if (bn - b.blockNumber() > CHECKPOINT_INTERVAL)
+        b = block; // the states before it aren't known yet
+    const int first = b.blockNumber();
+    forcedBlock = bn;
+    while (b.isValid() && b.blockNumber() <= bn)
+    {
+        rehighlightBlock (b);
+        if (b.blockNumber() > first)
+            dropScanData (b.previous());
+        b = b.next();
+    }
+    forcedBlock = -1;
+}
+/*************************/
+void Highlighter::setLazy (bool isLazy)
+{
+    lazy = isLazy;
+    scanned = 0;
+    rescanCursors.clear();
+    if (lazy)
+        scanTimer->start (0);
+    else
+        scanTimer->stop();
+}
+/*************************/
+// The states of the blocks after a change may change too.
+void Highlighter::onContentsChange (int pos, int charsRemoved, int charsAdded)
+{
+    if (!lazy || (charsRemoved == 0 && charsAdded == 0)) return;
+    rescanFrom (document()->findBlock (pos));
+}
+/*************************/
+// In the lazy mode, the states of the blocks from the given one on may be wrong
+// because a change wasn't propagated to them. They'll be scanned again until
+// their states are the same as before.
+void Highlighter::rescanFrom (const QTextBlock &block)
+{
+    if (!block.isValid() || block.blockNumber() >= scanned) return; // not scanned yet
+    for (int i = 0; i < rescanCursors.size(); ++i)
+    {
+        if (rescanCursors.at (i).block() == block) return;
+    }
+    QTextCursor cur (block);
+    cur.setKeepPositionOnInsert (true);
+    rescanCursors.append (cur);
+    scanTimer->start (SCAN_DELAY);
+}
+/*************************/
+// The number of the first block whose state may not be correct.
+int Highlighter::knownStates() const
+{
+    int known = scanned;
+    for (int i = 0; i < rescanCursors.size(); ++i)
+        known = qMin (known, rescanCursors.at (i).blockNumber());
+    return known;
+}
+/*************************/
+// Finds the states of the blocks in time slices, from the last checkpoint before
+// the first block that should be (re)scanned. Far blocks are only scanned for
+// their states; the blocks around the viewport are also highlighted, which
+// corrects them if they have been highlighted provisionally.
+// A rescan stops, like QSyntaxHighlighter, as soon as a block gets its old state
+// and the next block hasn't been deferred, because the next blocks are correct.
+// Then it continues from the next rescan place or from "scanned".
+void Highlighter::scanStates()
+{
+    if (!lazy || !document()) return;
+    QElapsedTimer timer;
+    timer.start();
+    int from = knownStates();
+    while (from < document()->blockCount())
+    {
+        QTextBlock block = resumeBlock (from);
+        const int first = block.blockNumber();
+        while (block.isValid())
+        {
+            const int bn = block.blockNumber();
+            if (timer.elapsed() >= SLICE_DURATION)
+            {
+                if (bn > first)
+                    rescanFrom (block); // continue from here
+                scanTimer->start (0);
+                return;
+            }
+            const int oldState = block.userState();
+            forcedBlock = bn;
+            rehighlightBlock (block);
+            forcedBlock = -1;
+            if (bn > first)
+                dropScanData (block.previous());
+            for (int i = rescanCursors.size() - 1; i >= 0; --i)
+            {
+                if (rescanCursors.at (i).blockNumber() <= bn)
+                    rescanCursors.removeAt (i);
+            }
+            if (bn >= scanned)
+                scanned = bn + 1;
+            else if (bn >= from && block.userState() == oldState)
+            {
+                QTextBlock next = block.next();
+                TextBlockData *data = static_cast<TextBlockData *>(next.userData());
+                if (!next.isValid() || next.blockNumber() >= scanned
+                    || !data || !data->isDeferred())
+                {
+                    break; // converged
+                }
+            }
+            block = block.next();
+        }
+        from = knownStates();
+    }
+}
+/*************************/
 void Highlighter::highlightBlock (const QString &text)
 {
+    /* keep the bracket index in sync with the blocks
+       (QSyntaxHighlighter starts from the changed block) */
+    int bn = currentBlock().blockNumber();
+    stateOnly = lazy && !isNearView (bn);
+    int count = document()->blockCount();
+    int indexed = bracketIndex.size();
+    if (indexed == 0)
+        bracketIndex.reset (count);
+    else if (count > indexed)
+        bracketIndex.insertBlocks (bn + 1, count - indexed);
+    else if (count < indexed)
+        bracketIndex.removeBlocks (bn + 1, indexed - count);
+
+    highlightText (text);
+    indexBrackets();
+}
+/*************************/
+// Puts the bracket infos of the current block into the bracket index. Far blocks
+// are indexed too because their states, and so their brackets, are correct.
+void Highlighter::indexBrackets()
+{
+    TextBlockData *data = static_cast<TextBlockData *>(currentBlock().userData());
+    bracketIndex.setBlock (currentBlock().blockNumber(),
+                           data && !data->isDeferred() ? data : nullptr);
+}
+/*************************/
+// Shift the here-doc regions when the number of blocks changes. This is called
+// before highlighting because QSyntaxHighlighter starts from the changed block.
+void Highlighter::updateHereDocIndex (int blockNumber)
+{
+    int count = document()->blockCount();
+    if (count == hereDocBlockCount) return;
+    int delta = count - hereDocBlockCount;
+    hereDocBlockCount = count;
+    if (hereDocs.isEmpty()) return;
+
+    QMap<int, HereDocRegion> shifted;
+    QMap<int, HereDocRegion>::const_iterator it = hereDocs.constBegin();
+    while (it != hereDocs.constEnd())
+    {
+        int start = it.key();
+        HereDocRegion region = it.value();
+        ++it;
+        if (start > blockNumber)
+        {
+            start += delta;
+            if (start <= blockNumber) continue; // removed
+        }
+        if (region.endBlock > blockNumber)
+        {
+            region.endBlock += delta;
+            if (region.endBlock <= blockNumber)
+                region.endBlock = -1;
+        }
+        shifted.insert (start, region);
+    }
+    hereDocs = shifted;
+}
+/*************************/
+// Returns the end block of the here-doc containing the given block (-1 if not known).
+int Highlighter::hereDocEnd (int blockNumber) const
+{
+    QMap<int, HereDocRegion>::const_iterator it = hereDocs.upperBound (blockNumber);
+    if (it == hereDocs.constBegin()) return -1;
+    --it;
+    return (it.value().endBlock > blockNumber ? it.value().endBlock : -1);
+}
+/*************************/
+// Start syntax highlighting!
+void Highlighter::highlightText (const QString &text)
+{
+    tokenClasses.fill (noClass, text.length()); // QSyntaxHighlighter has cleared the formats
+    ++spanGeneration; // a new block
     if (progLan.isEmpty()) return;
 
+    if (!hereDocDelimExp.isEmpty())
+        updateHereDocIndex (currentBlock().blockNumber());
+
+    if (deferHighlighting()) return;
+
     bool rehighlightNextBlock = false;
     int oldOpenNests = 0; QSet<int> oldOpenQuotes; // to be used in SH_CmndSubstVar()
     if (TextBlockData *oldData = static_cast<TextBlockData *>(currentBlockUserData()))
@@ -2413,8 +2996,11 @@ void Highlighter::highlightBlock (const QString &text)
     }
 
     int index;
-    TextBlockData *data = new TextBlockData;
-    data->insertHighlightInfo (false); // not highlighted yet
+    TextBlockData *data = static_cast<TextBlockData *>(currentBlockUserData());
+    if (data) // reuse the old data
+        data->reset(); // not highlighted yet
+    else
+        data = new TextBlockData;
     setCurrentBlockUserData (data); // to be fed in later
     setCurrentBlockState (0);
 
@@ -2439,7 +3025,14 @@ void Highlighter::highlightBlock (const QString &text)
                         if (nextData->openQuotes() != data->openQuotes()
                             || (nextBlock.userState() >= 0 && nextBlock.userState() < endState)) // end delimiter
                         {
-                            QMetaObject::invokeMethod (this, "rehighlightBlock", Qt::QueuedConnection, Q_ARG (QTextBlock, nextBlock));
+                            /* defer the rest of the here-doc at once (if its end is known) */
+                            int end = hereDocEnd (currentBlock().blockNumber());
+                            while (nextBlock.isValid())
+                            {
+                                deferBlock (nextBlock);
+                                if (nextBlock.blockNumber() >= end) break;
+                                nextBlock = nextBlock.next();
+                            }
                         }
                     }
                 }
@@ -2453,7 +3046,7 @@ void Highlighter::highlightBlock (const QString &text)
 
     int bn = currentBlock().blockNumber();
     bool mainFormatting (bn >= startCursor.blockNumber() && bn <= endCursor.blockNumber());
-    QTextCharFormat fi;
+    int tc;
 
     /************************
      * Single-Line Comments *
@@ -2538,14 +3131,14 @@ void Highlighter::highlightBlock (const QString &text)
                 index = expression.indexIn (text);
                 if (rule.format != whiteSpaceFormat)
                 {
-                    fi = format (index);
+                    tc = tokenClass (index);
                     while (index >= 0
-                           && (fi == blockQuoteFormat || fi == codeBlockFormat // the same as quoteFormat (for `...`)
-                               || fi == commentFormat || fi == urlFormat
-                               || fi.fontWeight() == QFont::Bold || fi.fontItalic()))
+                           && (tc == blockQuoteClass || tc == quoteClass // also code blocks (and `...`)
+                               || tc == commentClass || tc == urlClass
+                               || tc == emphasisClass || tc == altQuoteClass))
                     {
                         index = expression.indexIn (text, index + expression.matchedLength());
-                        fi = format (index);
+                        tc = tokenClass (index);
                     }
                 }
                 while (index >= 0)
@@ -2555,14 +3148,14 @@ void Highlighter::highlightBlock (const QString &text)
                     index = expression.indexIn (text, index + length);
                     if (rule.format != whiteSpaceFormat)
                     {
-                        fi = format (index);
+                        tc = tokenClass (index);
                         while (index >= 0
-                               && (fi == blockQuoteFormat || fi == codeBlockFormat
-                                   || fi == commentFormat || fi == urlFormat
-                                   || fi.fontWeight() == QFont::Bold || fi.fontItalic()))
+                               && (tc == blockQuoteClass || tc == quoteClass
+                                   || tc == commentClass || tc == urlClass
+                                   || tc == emphasisClass || tc == altQuoteClass))
                         {
                             index = expression.indexIn (text, index + expression.matchedLength());
-                            fi = format (index);
+                            tc = tokenClass (index);
                         }
                     }
                 }
@@ -2602,14 +3195,14 @@ void Highlighter::highlightBlock (const QString &text)
             /* skip quotes and all comments */
             if (rule.format != whiteSpaceFormat)
             {
-                fi = format (index);
+                tc = tokenClass (index);
                 while (index >= 0
-                       && (fi == quoteFormat || fi == altQuoteFormat
-                           || fi == commentFormat || fi == urlFormat
-                           || fi == JSRegexFormat))
+                       && (tc == quoteClass || tc == altQuoteClass
+                           || tc == commentClass || tc == urlClass
+                           || tc == JSRegexClass))
                 {
                     index = expression.indexIn (text, index + expression.matchedLength());
-                    fi = format (index);
+                    tc = tokenClass (index);
                 }
             }
 
@@ -2622,12 +3215,12 @@ void Highlighter::highlightBlock (const QString &text)
                    part of the match is inside an already formatted region. */
                 if (rule.format != whiteSpaceFormat)
                 {
-                    while (format (index + l - 1) == commentFormat
-                           /*|| format (index + l - 1) == commentFormat
-                           || format (index + l - 1) == urlFormat
-                           || format (index + l - 1) == quoteFormat
-                           || format (index + l - 1) == altQuoteFormat
-                           || format (index + l - 1) == JSRegexFormat*/)
+                    while (tokenClass (index + l - 1) == commentClass
+                           /*|| tokenClass (index + l - 1) == commentClass
+                           || tokenClass (index + l - 1) == urlClass
+                           || tokenClass (index + l - 1) == quoteClass
+                           || tokenClass (index + l - 1) == altQuoteClass
+                           || tokenClass (index + l - 1) == JSRegexClass*/)
                     {
                         -- l;
                     }
@@ -2637,14 +3230,14 @@ void Highlighter::highlightBlock (const QString &text)
 
                 if (rule.format != whiteSpaceFormat)
                 {
-                    fi = format (index);
+                    tc = tokenClass (index);
                     while (index >= 0
-                           && (fi == quoteFormat || fi == altQuoteFormat
-                               || fi == commentFormat || fi == urlFormat
-                               || fi == JSRegexFormat))
+                           && (tc == quoteClass || tc == altQuoteClass
+                               || tc == commentClass || tc == urlClass
+                               || tc == JSRegexClass))
                     {
                         index = expression.indexIn (text, index + expression.matchedLength());
-                        fi = format (index);
+                        tc = tokenClass (index);
                     }
                 }
             }
@@ -2657,192 +3250,188 @@ void Highlighter::highlightBlock (const QString &text)
 
     /* left parenthesis */
     index = text.indexOf ('(');
-    fi = format (index);
+    tc = tokenClass (index);
     while (index >= 0
-           && (fi == quoteFormat || fi == altQuoteFormat
-               || fi == commentFormat || fi == urlFormat
-               || fi == JSRegexFormat))
+           && (tc == quoteClass || tc == altQuoteClass
+               || tc == commentClass || tc == urlClass
+               || tc == JSRegexClass))
     {
         index = text.indexOf ('(', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
     }
     while (index >= 0)
     {
-        ParenthesisInfo *info = new ParenthesisInfo;
-        info->character = '(';
-        info->position = index;
+        ParenthesisInfo info;
+        info.character = '(';
+        info.position = index;
         data->insertInfo (info);
 
         index = text.indexOf ('(', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
         while (index >= 0
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             index = text.indexOf ('(', index + 1);
-            fi = format (index);
+            tc = tokenClass (index);
         }
     }
 
     /* right parenthesis */
     index = text.indexOf (')');
-    fi = format (index);
+    tc = tokenClass (index);
     while (index >= 0
-           && (fi == quoteFormat || fi == altQuoteFormat
-               || fi == commentFormat || fi == urlFormat
-               || fi == JSRegexFormat))
+           && (tc == quoteClass || tc == altQuoteClass
+               || tc == commentClass || tc == urlClass
+               || tc == JSRegexClass))
     {
         index = text.indexOf (')', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
     }
     while (index >= 0)
     {
-        ParenthesisInfo *info = new ParenthesisInfo;
-        info->character = ')';
-        info->position = index;
+        ParenthesisInfo info;
+        info.character = ')';
+        info.position = index;
         data->insertInfo (info);
 
         index = text.indexOf (')', index +1);
-        fi = format (index);
+        tc = tokenClass (index);
         while (index >= 0
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             index = text.indexOf (')', index + 1);
-            fi = format (index);
+            tc = tokenClass (index);
         }
     }
 
     /* left brace */
     index = text.indexOf ('{');
-    fi = format (index);
+    tc = tokenClass (index);
     while (index >= 0
-           && (fi == quoteFormat || fi == altQuoteFormat
-               || fi == commentFormat || fi == urlFormat
-               || fi == JSRegexFormat))
+           && (tc == quoteClass || tc == altQuoteClass
+               || tc == commentClass || tc == urlClass
+               || tc == JSRegexClass))
     {
         index = text.indexOf ('{', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
     }
     while (index >= 0)
     {
-        BraceInfo *info = new BraceInfo;
-        info->character = '{';
-        info->position = index;
+        BraceInfo info;
+        info.character = '{';
+        info.position = index;
         data->insertInfo (info);
 
         index = text.indexOf ('{', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
         while (index >= 0
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             index = text.indexOf ('{', index + 1);
-            fi = format (index);
+            tc = tokenClass (index);
         }
     }
 
     /* right brace */
     index = text.indexOf ('}');
-    fi = format (index);
+    tc = tokenClass (index);
     while (index >= 0
-           && (fi == quoteFormat || fi == altQuoteFormat
-               || fi == commentFormat || fi == urlFormat
-               || fi == JSRegexFormat))
+           && (tc == quoteClass || tc == altQuoteClass
+               || tc == commentClass || tc == urlClass
+               || tc == JSRegexClass))
     {
         index = text.indexOf ('}', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
     }
     while (index >= 0)
     {
-        BraceInfo *info = new BraceInfo;
-        info->character = '}';
-        info->position = index;
+        BraceInfo info;
+        info.character = '}';
+        info.position = index;
         data->insertInfo (info);
 
         index = text.indexOf ('}', index +1);
-        fi = format (index);
+        tc = tokenClass (index);
         while (index >= 0
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             index = text.indexOf ('}', index + 1);
-            fi = format (index);
+            tc = tokenClass (index);
         }
     }
 
     /* left bracket */
     index = text.indexOf ('[');
-    fi = format (index);
+    tc = tokenClass (index);
     while (index >= 0
-           && (fi == quoteFormat || fi == altQuoteFormat
-               || fi == commentFormat || fi == urlFormat
-               || fi == JSRegexFormat))
+           && (tc == quoteClass || tc == altQuoteClass
+               || tc == commentClass || tc == urlClass
+               || tc == JSRegexClass))
     {
         index = text.indexOf ('[', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
     }
     while (index >= 0)
     {
-        BracketInfo *info = new BracketInfo;
-        info->character = '[';
-        info->position = index;
+        BracketInfo info;
+        info.character = '[';
+        info.position = index;
         data->insertInfo (info);
 
         index = text.indexOf ('[', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
         while (index >= 0
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             index = text.indexOf ('[', index + 1);
-            fi = format (index);
+            tc = tokenClass (index);
         }
     }
 
     /* right bracket */
     index = text.indexOf (']');
-    fi = format (index);
+    tc = tokenClass (index);
     while (index >= 0
-           && (fi == quoteFormat || fi == altQuoteFormat
-               || fi == commentFormat || fi == urlFormat
-               || fi == JSRegexFormat))
+           && (tc == quoteClass || tc == altQuoteClass
+               || tc == commentClass || tc == urlClass
+               || tc == JSRegexClass))
     {
         index = text.indexOf (']', index + 1);
-        fi = format (index);
+        tc = tokenClass (index);
     }
     while (index >= 0)
     {
-        BracketInfo *info = new BracketInfo;
-        info->character = ']';
-        info->position = index;
+        BracketInfo info;
+        info.character = ']';
+        info.position = index;
         data->insertInfo (info);
 
         index = text.indexOf (']', index +1);
-        fi = format (index);
+        tc = tokenClass (index);
         while (index >= 0
-               && (fi == quoteFormat || fi == altQuoteFormat
-                   || fi == commentFormat || fi == urlFormat
-                   || fi == JSRegexFormat))
+               && (tc == quoteClass || tc == altQuoteClass
+                   || tc == commentClass || tc == urlClass
+                   || tc == JSRegexClass))
         {
             index = text.indexOf (']', index + 1);
-            fi = format (index);
+            tc = tokenClass (index);
         }
     }
 
     setCurrentBlockUserData (data);
 
     if (rehighlightNextBlock)
-    {
-        QTextBlock nextBlock = currentBlock().next();
-        if (nextBlock.isValid())
-            QMetaObject::invokeMethod (this, "rehighlightBlock", Qt::QueuedConnection, Q_ARG (QTextBlock, nextBlock));
-    }
+        deferBlock (currentBlock().next());
 }
 
 }
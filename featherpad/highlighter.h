@@ -21,6 +21,12 @@
 #define HIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTimer>
+#include <QVarLengthArray>
+#include <algorithm> // std::upper_bound
+#include "bracketindex.h"
 
 namespace FeatherPad {
 
@@ -44,36 +50,46 @@ struct BracketInfo
 
 
 /* This class is for detection of matching parentheses and
-   braces, and also for highlighting of here-documents. */
+   braces, and also for highlighting of here-documents.
+   It's reused when its block is rehighlighted and the bracket
+   infos are kept inline, so that highlighting doesn't need
+   heap allocations in most cases. */
 class TextBlockData : public QTextBlockUserData
 {
 public:
-    TextBlockData() { Highlighted = false; Property = false; OpenNests = 0; }
-    ~TextBlockData();
-    QVector<ParenthesisInfo *> parentheses() const;
-    QVector<BraceInfo *> braces() const;
-    QVector<BracketInfo *> brackets() const;
+    typedef QVarLengthArray<ParenthesisInfo, 4> ParenthesisList;
+    typedef QVarLengthArray<BraceInfo, 2> BraceList;
+    typedef QVarLengthArray<BracketInfo, 2> BracketList;
+
+    TextBlockData() { Highlighted = false; Property = false; Deferred = false; OpenNests = 0; }
+    void reset();
+    const ParenthesisList &parentheses() const;
+    const BraceList &braces() const;
+    const BracketList &brackets() const;
     QString labelInfo() const;
     bool isHighlighted() const;
     bool getProperty() const;
+    bool isDeferred() const;
     int openNests() const;
     QSet<int> openQuotes() const;
-    void insertInfo (ParenthesisInfo *info);
-    void insertInfo (BraceInfo *info);
-    void insertInfo (BracketInfo *info);
+    void insertInfo (const ParenthesisInfo &info);
+    void insertInfo (const BraceInfo &info);
+    void insertInfo (const BracketInfo &info);
     void insertInfo (const QString &str);
     void insertHighlightInfo (bool highlighted);
     void setProperty (bool p);
+    void setDeferred (bool deferred);
     void insertNestInfo (int nests);
     void insertOpenQuotes (const QSet<int> &openQuotes);
 
 private:
-    QVector<ParenthesisInfo *> allParentheses;
-    QVector<BraceInfo *> allBraces;
-    QVector<BracketInfo *> allBrackets;
+    ParenthesisList allParentheses;
+    BraceList allBraces;
+    BracketList allBrackets;
     QString label; // A label (usually, the delimiter string of a here-doc).
     bool Highlighted; // Is this block completely highlighted?
     bool Property; // A general boolean property (use with SH).
+    bool Deferred; // Should this block be highlighted later?
     /* "Nest" is a generalized bracket. This variable
        is the number of unclosed nests in a block. */
     int OpenNests;
@@ -96,11 +112,39 @@ public:
         startCursor = start;
         endCursor = end;
     }
+    void setLazy (bool isLazy);
+
+    void highlightDeferred (int lastBlockNumber);
+    void restoreData (const QTextBlock &block);
+    const BracketIndex &getBracketIndex() const {
+        return bracketIndex;
+    }
 
 protected:
     void highlightBlock (const QString &text);
 
+private slots:
+    void resumeHighlighting();
+    void endSlice();
+    void scanStates();
+    void onContentsChange (int pos, int charsRemoved, int charsAdded);
+
 private:
+    void setFormat (int start, int count, const QTextCharFormat &format);
+    int tokenClass (int pos) const {
+        return (pos >= 0 && pos < tokenClasses.size() ? tokenClasses.at (pos) : noClass);
+    }
+    void highlightText (const QString &text);
+    bool deferHighlighting();
+    void keepOldFormats();
+    void deferBlock (const QTextBlock &block);
+    void deferFrom (int blockNumber);
+    bool isNearView (int blockNumber) const;
+    void evictFarBlocks();
+    QTextBlock resumeBlock (int blockNumber) const;
+    void dropScanData (QTextBlock block);
+    void rescanFrom (const QTextBlock &block);
+    int knownStates() const;
     QStringList keywords (const QString &lang);
     QStringList types();
     bool isEscapedChar (const QString &text, const int pos);
@@ -110,6 +154,9 @@ private:
                    bool skipCommandSign = false);
     bool isMLCommented (const QString &text, const int index, int comState = commentState);
     bool isHereDocument (const QString &text);
+    void indexBrackets();
+    void updateHereDocIndex (int blockNumber);
+    int hereDocEnd (int blockNumber) const;
     void pythonMLComment (const QString &text, const int indx);
     void htmlCSSHighlighter (const QString &text, const int start = 0);
     void htmlBrackets (const QString &text, const int start = 0);
@@ -169,15 +216,108 @@ private:
     QTextCharFormat translucentFormat;
     QTextCharFormat JSRegexFormat;
 
+    /* The nesting changes of brackets in all blocks: */
+    BracketIndex bracketIndex;
+
+    /* Here-documents (sh, perl and ruby): */
+    QRegExp hereDocDelimExp, hereDocCommentExp;
+    QRegExp hereDocEndExp; // only for perl and ruby
+    QString hereDocEndDelim; // the delimiter of hereDocEndExp
+    struct HereDocRegion
+    {
+        QString delimiter;
+        int endBlock; // -1 if not known
+    };
+    /* The here-doc regions keyed by their start blocks. They're updated while
+       highlighting and are shifted when the number of blocks changes. */
+    QMap<int, HereDocRegion> hereDocs;
+    int hereDocBlockCount;
+
+    /* The token classes of the characters of the current block, which are
+       set with their formats and are used instead of format comparisons: */
+    enum TokenClass
+    {
+        noClass = 0,
+        commentClass,
+        urlClass,
+        quoteClass, // also code blocks of markdown
+        altQuoteClass,
+        blockQuoteClass,
+        JSRegexClass,
+        neutralClass,
+        emphasisClass, // bold or italic text of markdown
+        cssValueClass,
+        cssErrorClass
+    };
+    QVector<uchar> tokenClasses;
+
+    /* The positions where quotes, multiline comments or JS regexes start or end
+       in the current block. A table is made by scanning the block once and is
+       valid until a token class, the block state or the block changes. */
+    struct SpanTable
+    {
+        SpanTable() : generation (-1), key (0), length (-1), initial (0), startsInside (false) {}
+        bool isValid (int gen, int k, int len) const {
+            return generation == gen && key == k && length == len;
+        }
+        bool isInside (int pos) const {
+            int n = std::upper_bound (toggles.constBegin(), toggles.constEnd(), pos)
+                    - toggles.constBegin();
+            if (n == 0) return startsInside;
+            return (initial + n) % 2 != 0;
+        }
+        int generation;
+        int key;
+        int length;
+        int initial; // 1 if the block starts inside a span
+        bool startsInside;
+        QVector<int> toggles; // sorted positions
+    };
+    SpanTable quoteSpans[2]; // with and without skipping the command sign
+    SpanTable commentSpans;
+    SpanTable JSRegexSpans;
+    int spanGeneration;
+
     /* Programming language: */
     QString progLan;
 
     QRegExp quoteMark;
+    QChar quoteChar; // the character of quoteMark
+
+    /* HTML expressions, which are created only once: */
+    QRegExp htmlBraStartExp, htmlStyleExp, htmlQuoteExp, htmlAttExp;
+    QRegExp htmlCSSStartExp, htmlCSSEndExp, htmlJSStartExp, htmlJSEndExp;
+    QRegExp htmlCommentStartExp, htmlCommentEndExp, cCommentStartExp, cCommentEndExp;
     QColor Blue, DarkBlue, Red, DarkRed, Verda, DarkGreen, DarkGreenAlt, DarkMagenta, Violet, Brown, DarkYellow;
 
     /* The start and end cursors of the visible text: */
     QTextCursor startCursor, endCursor;
 
+    /* Off-screen blocks are highlighted in time slices, so that
+       a change in a block state doesn't freeze the editor: */
+    QTimer *resumeTimer; // resumes the deferred highlighting
+    QElapsedTimer sliceTimer; // measures the current time slice
+    int deferredBlock; // the first deferred block (-1 if none)
+    int forcedBlock; // blocks up to this one shouldn't be deferred
+
+    /* In the lazy mode (for huge texts), only the blocks around the viewport
+       are highlighted and the formats and data of far blocks are removed.
+       Meanwhile, a background scan finds the states of all blocks in time
+       slices without formatting them and keeps the data of every Nth block
+       as a checkpoint. The blocks before "scanned" have correct states, so
+       that highlighting the viewport is resumed from the nearest checkpoint
+       before it. Until the scan reaches the viewport, its blocks are
+       highlighted provisionally and are corrected by the scan later. The
+       bracket index keeps the nesting changes of all scanned blocks.
+       After a change, only the places where its propagation was cut off
+       are scanned again, until the old states are reached. */
+    bool lazy;
+    int keptFirst, keptLast; // the range of blocks that may have formats (-1 if none)
+    QTimer *scanTimer;
+    int scanned; // the number of the first block whose state isn't known
+    QList<QTextCursor> rescanCursors; // the blocks before "scanned" that should be scanned again
+    bool stateOnly; // the current block is far from the view and isn't formatted
+
     /* Block states: */
     enum
     {
@@ -82,27 +82,9 @@ void Loading::run()
             C[num] = c;
             ++ num;
         }
-        if (num == 2 && ((C[0] != '\0' && C[1] == '\0') || (C[0] == '\0' && C[1] != '\0')))
-            charset_ = "UTF-16"; // single character
-        else if (num == 4)
+        charset_ = detectUnicodeCharset (C, num);
+        if (num == 4)
         {
-            if (hasNull)
-            {
-                if ((C[0] == 0xFF && C[1] == 0xFE && C[2] != '\0' && C[3] == '\0') // le
-                    || (C[0] == 0xFE && C[1] == 0xFF && C[2] == '\0' && C[3] != '\0') // be
-                    || (C[0] != '\0' && C[1] == '\0' && C[2] != '\0' && C[3] == '\0') // le
-                    || (C[0] == '\0' && C[1] != '\0' && C[2] == '\0' && C[3] != '\0')) // be
-                {
-                    charset_ = "UTF-16";
-                }
-                /*else if ((C[0] == 0xFF && C[1] == 0xFE && C[2] == '\0' && C[3] == '\0')
-                          || (C[0] == '\0' && C[1] == '\0' && C[2] == 0xFE && C[3] == 0xFF))*/
-                else if ((C[0] != '\0' && C[1] != '\0' && C[2] == '\0' && C[3] == '\0') // le
-                         || (C[0] == '\0' && C[1] == '\0' && C[2] != '\0' && C[3] != '\0')) // be
-                {
-                    charset_ = "UTF-32";
-                }
-            }
             /* reading may still be possible */
             if (charset_.isEmpty() && !hasNull)
             {
@@ -19,6 +19,11 @@
 
 #include "fpwin.h"
 #include "ui_fp.h"
+#include "textsearch.h"
+#include "replacing.h"
+
+/* more replacements are done in one edit and aren't all highlighted */
+#define MAX_GREEN_SEL 1000
 
 namespace FeatherPad {
 
@@ -152,8 +157,15 @@ void FPwin::replace()
         start.setPosition (found.anchor());
         pos = found.anchor();
         start.setPosition (found.position(), QTextCursor::KeepAnchor);
+        QString replacement = txtReplace_;
+        if (isRegexSearch())
+        { // substitute captured texts
+            TextSearch *search = textSearch (txtFind, searchFlags, true);
+            search->setTextRevision (textEdit->getTextRevision());
+            replacement = search->replacement (textEdit->plainTextSnapshot(), pos, txtReplace_);
+        }
         textEdit->setTextCursor (start);
-        textEdit->insertPlainText (txtReplace_);
+        textEdit->insertPlainText (replacement);
 
         start = textEdit->textCursor();
         tmp.setPosition (pos);
@@ -187,6 +199,8 @@ void FPwin::replaceAll()
     QString txtFind = ui->lineEditFind->text();
     if (txtFind.isEmpty()) return;
 
+    if (replacingThread_ != nullptr) return; // wait for the previous regex replacement
+
     /* remove previous green highlights if the replacing text is changed */
     if (txtReplace_ != ui->lineEditReplace->text())
     {
@@ -195,44 +209,171 @@ void FPwin::replaceAll()
     }
 
     QTextDocument::FindFlags searchFlags = getSearchFlags();
+    Qt::CaseSensitivity cs = searchFlags & QTextDocument::FindCaseSensitively ? Qt::CaseSensitive
+                                                                             : Qt::CaseInsensitive;
+
+    if (isRegexSearch())
+    {
+        /* replace regex matches in a thread and apply the result when it's ready
+           (the thread shares the snapshot that finding() searches) */
+        Replacing *thread = new Replacing (textEdit->plainTextSnapshot(), txtFind, txtReplace_, cs,
+                                           searchFlags & QTextDocument::FindWholeWords, MAX_GREEN_SEL);
+        replacingThread_ = thread;
+        QPointer<TextEdit> editPtr (textEdit);
+        const int textRevision = textEdit->getTextRevision();
+        connect (thread, &Replacing::completed, this,
+                 [this, editPtr, textRevision] (const QString newText, int first, int last, int count,
+                                                const QVector<int> highlights) {
+            if (editPtr)
+                applyReplacements (editPtr, textRevision, newText, first, last, count, highlights);
+            else
+                ui->dockReplace->setWindowTitle (tr ("Rep&lacement"));
+        });
+        connect (thread, &Replacing::finished, thread, &QObject::deleteLater);
+        ui->dockReplace->setWindowTitle (tr ("Replacing..."));
+        thread->start();
+        return;
+    }
+
+    /* find all matches in the same snapshot before changing the document */
+    QVector<int> matches;
+    const QString text = textEdit->plainTextSnapshot(); // it's cleared when the document changes
+    TextSearch *search = textSearch (txtFind, searchFlags, false);
+    int pos = 0;
+    while ((pos = search->indexIn (text, pos)) >= 0)
+    {
+        matches.append (pos);
+        pos += txtFind.length();
+    }
 
     QTextCursor orig = textEdit->textCursor();
     QTextCursor start = orig;
     QColor color = QColor (textEdit->hasDarkScheme() ? Qt::darkGreen : Qt::green);
-    int pos; QTextCursor found;
-    start.beginEditBlock();
-    start.setPosition (0);
+    const int findLength = txtFind.length();
+    const int count = matches.count();
     QTextCursor tmp = start;
-    QList<QTextEdit::ExtraSelection> gsel = textEdit->getGreenSel();
-    QList<QTextEdit::ExtraSelection> es;
-    int count = 0;
-    while (!(found = finding (txtFind, start, searchFlags)).isNull())
+    QList<QTextEdit::ExtraSelection> gsel;
+    start.beginEditBlock();
+    if (count <= MAX_GREEN_SEL)
     {
-        start.setPosition (found.anchor());
-        pos = found.anchor();
-        start.setPosition (found.position(), QTextCursor::KeepAnchor);
-        start.insertText (txtReplace_);
+        /* replace from the end, so that the positions of other matches don't change */
+        for (int i = count - 1; i >= 0; --i)
+        {
+            pos = matches.at (i);
+            start.setPosition (pos);
+            start.setPosition (pos + findLength, QTextCursor::KeepAnchor);
+            start.insertText (txtReplace_);
 
-        tmp.setPosition (pos);
-        tmp.setPosition (start.position(), QTextCursor::KeepAnchor);
-        start.setPosition (start.position());
-        QTextEdit::ExtraSelection extra;
-        extra.format.setBackground (color);
-        extra.cursor = tmp;
-        es.prepend (extra);
-        gsel.append (extra);
-        ++count;
+            tmp.setPosition (pos);
+            tmp.setPosition (start.position(), QTextCursor::KeepAnchor);
+            QTextEdit::ExtraSelection extra;
+            extra.format.setBackground (color);
+            extra.cursor = tmp;
+            gsel.prepend (extra);
+        }
+    }
+    else
+    {
+        /* make the new text of the whole range in one pass and insert it at once */
+        const int first = matches.first();
+        const int last = matches.last() + findLength;
+        start.setPosition (first);
+        start.setPosition (last, QTextCursor::KeepAnchor);
+        QString newText;
+        newText.reserve (last - first + count * (txtReplace_.length() - findLength));
+        int prev = first;
+        for (int i = 0; i < count; ++i)
+        {
+            pos = matches.at (i);
+            newText += text.midRef (prev, pos - prev);
+            newText += txtReplace_;
+            prev = pos + findLength;
+        }
+        start.insertText (newText);
+
+        /* highlight only the first replacements */
+        const int diff = txtReplace_.length() - findLength;
+        for (int i = 0; i < MAX_GREEN_SEL; ++i)
+        {
+            pos = matches.at (i) + i * diff;
+            tmp.setPosition (pos);
+            tmp.setPosition (pos + txtReplace_.length(), QTextCursor::KeepAnchor);
+            QTextEdit::ExtraSelection extra;
+            extra.format.setBackground (color);
+            extra.cursor = tmp;
+            gsel.append (extra);
+        }
     }
-    textEdit->setGreenSel (gsel);
     start.endEditBlock();
+    /* restore the original cursor without selection */
+    orig.setPosition (orig.anchor());
+    textEdit->setTextCursor (orig);
+
+    showReplacements (textEdit, gsel, count);
+}
+/*************************/
+// Puts the result of a regex replacement into the document in one edit if the
+// document hasn't changed since the replacement started. Otherwise, the result
+// is discarded and the user is told about it.
+void FPwin::applyReplacements (TextEdit *textEdit, int textRevision,
+                               const QString &newText, int first, int last, int count,
+                               const QVector<int> &highlights)
+{
+    if (textEdit->getTextRevision() != textRevision || textEdit->isReadOnly())
+    {
+        QString title = count > 0 ? tr ("Replacement Discarded") : tr ("No Replacement");
+        ui->dockReplace->setWindowTitle (title);
+        textEdit->setReplaceTitle (title);
+        if (count > 0 && textEdit == qobject_cast< TabPage *>(ui->tabWidget->currentWidget())->textEdit())
+        {
+            showWarningBar ("<center><b><big>" + tr ("Nothing replaced!") + "</big></b></center>\n"
+                            + "<center>" + (textEdit->isReadOnly() ? tr ("The text became read-only during replacement.")
+                                                                   : tr ("The text was changed during replacement."))
+                            + "</center>");
+        }
+        return;
+    }
+
+    QList<QTextEdit::ExtraSelection> gsel;
+    if (count > 0)
+    {
+        QTextCursor orig = textEdit->textCursor();
+        QTextCursor start = orig;
+        start.beginEditBlock();
+        start.setPosition (first);
+        start.setPosition (last, QTextCursor::KeepAnchor);
+        start.insertText (newText);
+        start.endEditBlock();
+        orig.setPosition (orig.anchor());
+        textEdit->setTextCursor (orig);
+
+        QColor color = QColor (textEdit->hasDarkScheme() ? Qt::darkGreen : Qt::green);
+        QTextCursor tmp = start;
+        for (int i = 0; i + 1 < highlights.size(); i += 2)
+        {
+            tmp.setPosition (highlights.at (i));
+            tmp.setPosition (highlights.at (i + 1), QTextCursor::KeepAnchor);
+            QTextEdit::ExtraSelection extra;
+            extra.format.setBackground (color);
+            extra.cursor = tmp;
+            gsel.append (extra);
+        }
+    }
+
+    showReplacements (textEdit, gsel, count);
+}
+/*************************/
+// Adds the green highlights of Replace All and shows the number of replacements.
+void FPwin::showReplacements (TextEdit *textEdit, const QList<QTextEdit::ExtraSelection> &gsel, int count)
+{
+    textEdit->setGreenSel (textEdit->getGreenSel() + gsel);
+    QList<QTextEdit::ExtraSelection> es = gsel;
     if ((ui->actionLineNumbers->isChecked() || ui->spinBox->isVisible()))
         es.prepend (textEdit->currentLineSelection());
     es.append (textEdit->getRedSel());
     textEdit->setExtraSelections (es);
-    hlight();
-    /* restore the original cursor without selection */
-    orig.setPosition (orig.anchor());
-    textEdit->setTextCursor (orig);
+    if (textEdit == qobject_cast< TabPage *>(ui->tabWidget->currentWidget())->textEdit())
+        hlight();
 
     QString title;
     if (count == 0)
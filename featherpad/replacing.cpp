@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "replacing.h"
+#include "textsearch.h"
+
+namespace FeatherPad {
+
+Replacing::Replacing (const QString &text, const QString &pattern, const QString &replaceWith,
+                      Qt::CaseSensitivity cs, bool wholeWords, int maxHighlights) :
+    text_ (text),
+    pattern_ (pattern),
+    replaceWith_ (replaceWith),
+    cs_ (cs),
+    wholeWords_ (wholeWords),
+    maxHighlights_ (maxHighlights)
+{}
+/*************************/
+Replacing::~Replacing() {}
+/*************************/
+void Replacing::run()
+{
+    TextSearch search (pattern_, cs_, wholeWords_, true);
+    search.setTextRevision (0); // the text doesn't change
+    QString newText;
+    QVector<int> highlights;
+    int first = -1, last = -1, count = 0;
+    int diff = 0; // the length difference between the new and old texts
+    int pos = 0, l;
+    while ((pos = search.indexIn (text_, pos, -1, &l)) >= 0)
+    {
+        if (isInterruptionRequested()) return;
+        if (first < 0)
+            first = last = pos;
+        newText += text_.midRef (last, pos - last);
+        const QString replacement = search.replacement (text_, pos, replaceWith_);
+        if (count < maxHighlights_)
+            highlights << pos + diff << pos + diff + replacement.length();
+        newText += replacement;
+        diff += replacement.length() - l;
+        last = pos = pos + l;
+        ++count;
+    }
+    emit completed (newText, first, last, count, highlights);
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef REPLACING_H
+#define REPLACING_H
+
+#include <QThread>
+#include <QVector>
+
+namespace FeatherPad {
+
+/* Replaces all matches of a regex in a copy of the document's text, where
+   line ends are '\n'. The new text of the range between the start of the
+   first match and the end of the last one is given to the GUI thread, which
+   puts it into the document in one edit if the document isn't changed. */
+class Replacing : public QThread {
+    Q_OBJECT
+
+public:
+    Replacing (const QString &text, const QString &pattern, const QString &replaceWith,
+               Qt::CaseSensitivity cs, bool wholeWords, int maxHighlights);
+    ~Replacing();
+
+signals:
+    /* "highlights" has the starts and ends of the first replacements in the new document */
+    void completed (const QString newText, int first, int last, int count,
+                    const QVector<int> highlights);
+
+private:
+    void run();
+
+    QString text_;
+    QString pattern_;
+    QString replaceWith_;
+    Qt::CaseSensitivity cs_;
+    bool wholeWords_;
+    int maxHighlights_;
+};
+
+}
+
+#endif // REPLACING_H
@@ -73,6 +73,16 @@ SearchBar::SearchBar(QWidget *parent,
     pushButton_whole_->setCheckable (true);
     pushButton_whole_->setFocusPolicy (Qt::NoFocus);
 
+    pushButton_regex_ = new QPushButton (this);
+    pushButton_regex_->setText (tr ("Regex"));
+    pushButton_regex_->setToolTip (tr ("Regular Expression"));
+    pushButton_regex_->setCheckable (true);
+    pushButton_regex_->setFocusPolicy (Qt::NoFocus);
+
+    label_count_ = new QLabel (this);
+    label_count_->setToolTip (tr ("Number of matches"));
+    label_count_->hide();
+
     /* there are shortcuts for forward/backward search */
     toolButton_nxt_->setFocusPolicy (Qt::NoFocus);
     toolButton_prv_->setFocusPolicy (Qt::NoFocus);
@@ -81,10 +91,12 @@ SearchBar::SearchBar(QWidget *parent,
     mainGrid->setHorizontalSpacing (1);
     mainGrid->setContentsMargins (2, 0, 2, 0);
     mainGrid->addWidget (lineEdit_, 0, 0);
-    mainGrid->addWidget (toolButton_nxt_, 0, 1);
-    mainGrid->addWidget (toolButton_prv_, 0, 2);
-    mainGrid->addWidget (pushButton_case_, 0, 3);
-    mainGrid->addWidget (pushButton_whole_, 0, 4);
+    mainGrid->addWidget (label_count_, 0, 1);
+    mainGrid->addWidget (toolButton_nxt_, 0, 2);
+    mainGrid->addWidget (toolButton_prv_, 0, 3);
+    mainGrid->addWidget (pushButton_case_, 0, 4);
+    mainGrid->addWidget (pushButton_whole_, 0, 5);
+    mainGrid->addWidget (pushButton_regex_, 0, 6);
     setLayout (mainGrid);
 
     connect (lineEdit_, &QLineEdit::returnPressed, this, &SearchBar::findForward);
@@ -92,6 +104,7 @@ SearchBar::SearchBar(QWidget *parent,
     connect (toolButton_prv_, &QAbstractButton::clicked, this, &SearchBar::findBackward);
     connect (pushButton_case_, &QAbstractButton::clicked, this, &SearchBar::searchFlagChanged);
     connect (pushButton_whole_, &QAbstractButton::clicked, this, &SearchBar::searchFlagChanged);
+    connect (pushButton_regex_, &QAbstractButton::clicked, this, &SearchBar::searchFlagChanged);
 }
 /*************************/
 void SearchBar::focusLineEdit()
@@ -135,6 +148,11 @@ bool SearchBar::matchWhole() const
     return pushButton_whole_->isChecked();
 }
 /*************************/
+bool SearchBar::matchRegex() const
+{
+    return pushButton_regex_->isChecked();
+}
+/*************************/
 // Used only in a workaround (-> FPwin::updateShortcuts())
 void SearchBar::updateShortcuts (bool disable)
 {
@@ -160,4 +178,11 @@ void SearchBar::setSearchIcons (QIcon iconNext, QIcon iconPrev)
     toolButton_prv_->setIcon (iconPrev);
 }
 
+/*************************/
+void SearchBar::setMatchCount (const QString &text)
+{
+    label_count_->setText (text);
+    label_count_->setVisible (!text.isEmpty());
+}
+
 }
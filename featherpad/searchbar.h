@@ -22,6 +22,7 @@
 
 #include <QPointer>
 #include <QPushButton>
+#include <QLabel>
 #include "lineedit.h"
 
 namespace FeatherPad {
@@ -42,9 +43,11 @@ public:
 
     bool matchCase() const;
     bool matchWhole() const;
+    bool matchRegex() const;
 
     void updateShortcuts (bool disable);
     void setSearchIcons (QIcon iconNext, QIcon iconPrev);
+    void setMatchCount (const QString &text);
 
 signals:
     void searchFlagChanged();
@@ -55,10 +58,12 @@ private:
     void findBackward();
 
     QPointer<LineEdit> lineEdit_;
+    QPointer<QLabel> label_count_;
     QPointer<QToolButton> toolButton_nxt_;
     QPointer<QToolButton> toolButton_prv_;
     QPointer<QPushButton> pushButton_case_;
     QPointer<QPushButton> pushButton_whole_;
+    QPointer<QPushButton> pushButton_regex_;
     QStringList shortcuts_;
 };
 
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "searchindex.h"
+#include "textedit.h"
+#include "textsearch.h"
+#include "searching.h"
+#include <algorithm>
+
+#define RESTART_DELAY 300 // in ms
+#define SNAPSHOT_SLICE 20 // in ms
+
+namespace FeatherPad {
+
+SearchIndex::SearchIndex (TextEdit *textEdit) : QObject (textEdit)
+{
+    textEdit_ = textEdit;
+    flags_ = 0;
+    regex_ = false;
+    search_ = nullptr;
+    scanned_ = 0;
+    complete_ = false;
+    generation_ = 0;
+
+    timer_ = new QTimer (this);
+    timer_->setSingleShot (true);
+    connect (timer_, &QTimer::timeout, this, &SearchIndex::build);
+    connect (textEdit->document(), &QTextDocument::contentsChange, this, &SearchIndex::onContentsChange);
+}
+/*************************/
+SearchIndex::~SearchIndex()
+{
+    cancel();
+    delete search_;
+}
+/*************************/
+// The thread isn't waited for because it has its own copy of the text.
+void SearchIndex::cancel()
+{
+    ++generation_;
+    if (thread_)
+    {
+        thread_->requestInterruption();
+        thread_ = nullptr;
+    }
+    timer_->stop();
+}
+/*************************/
+void SearchIndex::setSearch (const QString &str, QTextDocument::FindFlags flags, bool regex)
+{
+    if (str == str_ && flags == flags_ && regex == regex_) return;
+    cancel();
+    str_ = str;
+    flags_ = flags;
+    regex_ = regex;
+    matches_.clear();
+    lengths_.clear();
+    scanned_ = 0;
+    complete_ = false;
+    delete search_;
+    search_ = nullptr;
+    if (!str_.isEmpty())
+    {
+        search_ = new TextSearch (str_,
+                                  flags_ & QTextDocument::FindCaseSensitively ? Qt::CaseSensitive : Qt::CaseInsensitive,
+                                  flags_ & QTextDocument::FindWholeWords,
+                                  regex_);
+        if (!search_->isValid())
+        {
+            delete search_;
+            search_ = nullptr;
+        }
+    }
+    if (search_)
+        timer_->start (0);
+    emit changed();
+}
+/*************************/
+void SearchIndex::clear()
+{
+    setSearch (QString(), 0);
+}
+/*************************/
+bool SearchIndex::matchesIn (int from, int to, QVector<int> &positions, QVector<int> &lengths) const
+{
+    if (search_ == nullptr || (!complete_ && to >= scanned_))
+        return false;
+    const int first = std::lower_bound (matches_.constBegin(), matches_.constEnd(), from) - matches_.constBegin();
+    const int last = std::upper_bound (matches_.constBegin() + first, matches_.constEnd(), to) - matches_.constBegin();
+    positions = matches_.mid (first, last - first);
+    lengths = lengths_.mid (first, last - first);
+    return true;
+}
+/*************************/
+int SearchIndex::matchNumber (int start, int end) const
+{
+    if (search_ == nullptr) return 0;
+    const int i = std::lower_bound (matches_.constBegin(), matches_.constEnd(), start) - matches_.constBegin();
+    if (i < matches_.size() && matches_.at (i) == start && lengths_.at (i) == end - start)
+        return i + 1;
+    return 0;
+}
+/*************************/
+// Finds the matches starting in [from, to] by searching a small part of the
+// document, which also includes the characters needed for whole-word checks.
+// It's used only with literal searches.
+void SearchIndex::searchRange (int from, int to, QVector<int> &positions, QVector<int> &lengths) const
+{
+    QTextDocument *doc = textEdit_->document();
+    const int l = search_->length();
+    const int a = qMax (0, from - 1);
+    const int b = qMin (doc->characterCount() - 1, to + l + 1);
+    if (b - a < l) return;
+    const QString text = textEdit_->plainTextRange (a, b);
+
+    int pos = from - a;
+    while ((pos = search_->indexIn (text, pos, to - a)) >= 0)
+    {
+        positions.append (a + pos);
+        lengths.append (l);
+        pos += l;
+    }
+}
+/*************************/
+// Forgets the matches that end after "pos", so that they're searched for again.
+void SearchIndex::truncate (int pos)
+{
+    cancel();
+    int i = matches_.size();
+    while (i > 0 && matches_.at (i - 1) + lengths_.at (i - 1) > pos)
+        --i;
+    if (i < matches_.size())
+        pos = qMin (pos, matches_.at (i));
+    matches_.resize (i);
+    lengths_.resize (i);
+    scanned_ = complete_ ? pos : qMin (scanned_, pos);
+    if (i > 0)
+        scanned_ = qMax (scanned_, matches_.last() + lengths_.last());
+    complete_ = false;
+    timer_->start (RESTART_DELAY);
+}
+/*************************/
+void SearchIndex::onContentsChange (int pos, int charsRemoved, int charsAdded)
+{
+    if (search_ == nullptr || (charsRemoved == 0 && charsAdded == 0)) return;
+
+    if (regex_)
+    { // a regex match may depend on any text before or after it
+        truncate (textEdit_->document()->findBlock (pos).position());
+        emit changed();
+        return;
+    }
+
+    const int l = search_->length();
+    const int delta = charsAdded - charsRemoved;
+    const int from = qMax (0, pos - l); // a match ending at "pos" may not be a whole word anymore
+
+    if (!complete_ && scanned_ <= pos + charsRemoved)
+    { // the change isn't inside the indexed part
+        truncate (from);
+        emit changed();
+        return;
+    }
+
+    if (!complete_)
+    { // the thread's text is outdated; continue after typing
+        cancel();
+        timer_->start (RESTART_DELAY);
+    }
+
+    /* shift the later matches */
+    const int i0 = std::lower_bound (matches_.constBegin(), matches_.constEnd(), from) - matches_.constBegin();
+    int i1 = std::upper_bound (matches_.constBegin() + i0, matches_.constEnd(), pos + charsRemoved)
+             - matches_.constBegin();
+    const int count = matches_.size();
+    for (int i = i1; i < count; ++i)
+        matches_[i] += delta;
+    if (!complete_)
+        scanned_ += delta;
+
+    /* search the changed range again, without overlapping the previous match */
+    QVector<int> found, foundLengths;
+    searchRange (i0 > 0 ? qMax (from, matches_.at (i0 - 1) + l) : from, pos + charsAdded,
+                 found, foundLengths);
+    if (!found.isEmpty())
+    {
+        while (i1 < count && matches_.at (i1) < found.last() + l)
+            ++i1;
+        if (!complete_)
+            scanned_ = qMax (scanned_, found.last() + l);
+    }
+
+    /* replace the old matches of the range with the new ones */
+    const int n = found.size() - (i1 - i0);
+    if (n > 0)
+    {
+        matches_.insert (i0, n, 0);
+        lengths_.insert (i0, n, l);
+    }
+    else if (n < 0)
+    {
+        matches_.remove (i0, -n);
+        lengths_.remove (i0, -n);
+    }
+    std::copy (found.constBegin(), found.constEnd(), matches_.begin() + i0);
+    emit changed();
+}
+/*************************/
+void SearchIndex::build()
+{
+    if (search_ == nullptr || complete_) return;
+
+    cancel();
+    /* after changes, the snapshot is made in time slices, so that typing isn't blocked */
+    if (!textEdit_->makeSnapshot (SNAPSHOT_SLICE))
+    {
+        timer_->start (0);
+        return;
+    }
+    Searching *thread = new Searching (textEdit_->plainTextSnapshot(), str_,
+                                       flags_ & QTextDocument::FindCaseSensitively ? Qt::CaseSensitive : Qt::CaseInsensitive,
+                                       flags_ & QTextDocument::FindWholeWords,
+                                       regex_, scanned_, generation_);
+    thread_ = thread;
+    connect (thread, &Searching::found, this, &SearchIndex::onFound);
+    connect (thread, &Searching::finished, thread, &QObject::deleteLater);
+    thread->start();
+}
+/*************************/
+void SearchIndex::onFound (int generation, const QVector<int> positions, const QVector<int> lengths,
+                           int scanned, bool finished)
+{
+    if (generation != generation_) return; // an old result
+    matches_ += positions;
+    lengths_ += lengths;
+    scanned_ = scanned;
+    complete_ = finished;
+    emit changed();
+}
+
+}
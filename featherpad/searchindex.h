@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QPointer>
+#include <QTextDocument>
+#include <QTimer>
+#include <QVector>
+
+namespace FeatherPad {
+
+class TextEdit;
+class TextSearch;
+class Searching;
+
+/* The sorted start positions of all matches of the searched text in a
+   document. The index is made in a thread, after which matches in any
+   range are found by binary searches. The thread is canceled when the
+   search or the text changes and is restarted with a delay in the latter
+   case. When the document changes, only the matches around the changed
+   range are searched for again and the later ones are shifted. With
+   regular expressions, whose matches may be long, the matches after the
+   changed line are searched for again instead. */
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    SearchIndex (TextEdit *textEdit);
+    ~SearchIndex();
+
+    /* starts indexing if the text or flags differ from the current ones
+       (an empty text or an invalid regex clears the index) */
+    void setSearch (const QString &str, QTextDocument::FindFlags flags, bool regex = false);
+    void clear();
+
+    /* Returns true if all matches starting in [from, to] are known and,
+       in that case, puts their positions and lengths into the vectors. */
+    bool matchesIn (int from, int to, QVector<int> &positions, QVector<int> &lengths) const;
+
+    bool isActive() const {
+        return search_ != nullptr;
+    }
+    bool isComplete() const {
+        return search_ != nullptr && complete_;
+    }
+    int count() const {
+        return matches_.size();
+    }
+    /* the known matches (all of them if the index is complete) */
+    const QVector<int> &positions() const {
+        return matches_;
+    }
+    /* the 1-based number of the match in [start, end), or 0 if it isn't a known match */
+    int matchNumber (int start, int end) const;
+
+signals:
+    /* emitted when matches are found or the index is changed otherwise */
+    void changed();
+
+private slots:
+    void onContentsChange (int pos, int charsRemoved, int charsAdded);
+    void onFound (int generation, const QVector<int> positions, const QVector<int> lengths,
+                  int scanned, bool finished);
+    void build();
+
+private:
+    void searchRange (int from, int to, QVector<int> &positions, QVector<int> &lengths) const;
+    void truncate (int pos);
+    void cancel();
+
+    TextEdit *textEdit_;
+    QTimer *timer_;
+    QString str_;
+    QTextDocument::FindFlags flags_;
+    bool regex_;
+    TextSearch *search_;
+    QVector<int> matches_;
+    QVector<int> lengths_;
+    int scanned_; // all matches starting before this position are known
+    bool complete_;
+    QPointer<Searching> thread_;
+    int generation_; // the generation of the current thread's results
+};
+
+}
+
+#endif // SEARCHINDEX_H
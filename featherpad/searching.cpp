@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "searching.h"
+#include "textsearch.h"
+#include <QElapsedTimer>
+
+#define BATCH_TIME 50 // in ms
+#define WINDOW_SIZE 65536 // in characters
+
+namespace FeatherPad {
+
+Searching::Searching (const QString &text, const QString &str, Qt::CaseSensitivity cs,
+                      bool wholeWords, bool regex, int from, int generation) :
+    text_ (text),
+    str_ (str),
+    cs_ (cs),
+    wholeWords_ (wholeWords),
+    regex_ (regex),
+    from_ (from),
+    generation_ (generation)
+{}
+/*************************/
+Searching::~Searching() {}
+/*************************/
+void Searching::run()
+{
+    TextSearch search (str_, cs_, wholeWords_, regex_);
+    search.setTextRevision (0); // the text doesn't change
+    QVector<int> positions, lengths;
+    QElapsedTimer timer;
+    timer.start();
+    /* the text is searched in windows, so that the thread can be
+       interrupted between them even if there's no match in them */
+    const int textLength = text_.length();
+    int pos = from_, l;
+    while (pos <= textLength)
+    {
+        if (isInterruptionRequested()) return;
+        const int windowEnd = qMin (pos + WINDOW_SIZE, textLength);
+        const int match = search.indexIn (text_, pos, windowEnd, &l);
+        if (match < 0)
+            pos = windowEnd + 1;
+        else
+        {
+            positions.append (match);
+            lengths.append (l);
+            pos = match + l;
+        }
+        if (timer.elapsed() > BATCH_TIME)
+        { // let the count be shown
+            emit found (generation_, positions, lengths, pos, false);
+            positions.clear();
+            lengths.clear();
+            timer.restart();
+        }
+    }
+    emit found (generation_, positions, lengths, text_.length() + 1, true);
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef SEARCHING_H
+#define SEARCHING_H
+
+#include <QThread>
+#include <QVector>
+
+namespace FeatherPad {
+
+/* Finds all matches in a copy of the document's text, starting from a given
+   position, and gives them to the GUI thread in batches. Results of a search
+   that is replaced by another one are recognized by their generation. */
+class Searching : public QThread {
+    Q_OBJECT
+
+public:
+    Searching (const QString &text, const QString &str, Qt::CaseSensitivity cs,
+               bool wholeWords, bool regex, int from, int generation);
+    ~Searching();
+
+signals:
+    /* "scanned" is the position before which all matches are found */
+    void found (int generation, const QVector<int> positions, const QVector<int> lengths,
+                int scanned, bool finished);
+
+private:
+    void run();
+
+    QString text_;
+    QString str_;
+    Qt::CaseSensitivity cs_;
+    bool wholeWords_;
+    bool regex_;
+    int from_;
+    int generation_;
+};
+
+}
+
+#endif // SEARCHING_H
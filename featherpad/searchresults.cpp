@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "searchresults.h"
+#include "textsearch.h"
+#include <QGridLayout>
+#include <QDir>
+#include <QElapsedTimer>
+#include <algorithm>
+
+#define SNAPSHOT_SLICE 20 // in ms
+
+namespace FeatherPad {
+
+SearchResults::SearchResults (QWidget *parent)
+    : QWidget (parent)
+{
+    generation_ = 0;
+    running_ = 0;
+    matches_ = 0;
+    more_ = false;
+    cs_ = Qt::CaseInsensitive;
+    wholeWords_ = regex_ = false;
+
+    snapshotTimer_ = new QTimer (this);
+    snapshotTimer_->setSingleShot (true);
+    connect (snapshotTimer_, &QTimer::timeout, this, &SearchResults::makeSnapshots);
+
+    QGridLayout *mainGrid = new QGridLayout;
+    mainGrid->setVerticalSpacing (4);
+    mainGrid->setContentsMargins (0, 0, 0, 0);
+    label_ = new QLabel (this);
+    label_->setIndent (2);
+    mainGrid->addWidget (label_, 0, 0);
+    tree_ = new QTreeWidget (this);
+    tree_->setHeaderHidden (true);
+    tree_->setColumnCount (1);
+    tree_->setUniformRowHeights (true);
+    tree_->setSelectionMode (QAbstractItemView::SingleSelection);
+    mainGrid->addWidget (tree_, 1, 0);
+    setLayout (mainGrid);
+
+    connect (tree_, &QTreeWidget::itemClicked, this, &SearchResults::onActivated);
+    connect (tree_, &QTreeWidget::itemActivated, this, &SearchResults::onActivated);
+}
+/*************************/
+SearchResults::~SearchResults()
+{
+    cancel();
+}
+/*************************/
+// The threads aren't waited for because they have their own copies of the texts.
+void SearchResults::cancel()
+{
+    ++generation_;
+    for (int i = 0; i < threads_.size(); ++i)
+    {
+        if (threads_.at (i))
+            threads_.at (i)->requestInterruption();
+    }
+    threads_.clear();
+    running_ = 0;
+    snapshotTimer_->stop();
+    if (queue_)
+    {
+        queue_->cancel();
+        queue_.clear();
+    }
+}
+/*************************/
+// Cancels the previous search, clears the results and
+// returns false if nothing can be searched for.
+bool SearchResults::startSearch (const QString &str, Qt::CaseSensitivity cs, bool wholeWords, bool regex)
+{
+    cancel();
+    tree_->clear();
+    pages_.clear();
+    names_.clear();
+    groups_.clear();
+    groupIds_.clear();
+    dir_.clear();
+    matches_ = 0;
+    more_ = false;
+
+    if (!TextSearch (str, cs, wholeWords, regex).isValid())
+    {
+        label_->setText (regex ? tr ("Invalid regular expression") : QString());
+        return false;
+    }
+    return true;
+}
+/*************************/
+void SearchResults::startThread (Grepping *thread)
+{
+    const int generation = generation_;
+    threads_.append (thread);
+    ++running_;
+    connect (thread, &Grepping::found, this, &SearchResults::onFound);
+    connect (thread, &QThread::finished, this, [this, generation] {
+        if (generation != generation_) return;
+        --running_;
+        updateSummary();
+    });
+    connect (thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start();
+}
+/*************************/
+void SearchResults::searchTabs (const QList<TabPage*> &pages, const QString &str,
+                                Qt::CaseSensitivity cs, bool wholeWords, bool regex)
+{
+    if (!startSearch (str, cs, wholeWords, regex)) return;
+
+    str_ = str;
+    cs_ = cs;
+    wholeWords_ = wholeWords;
+    regex_ = regex;
+    for (int i = 0; i < pages.size(); ++i)
+    {
+        TabPage *tabPage = pages.at (i);
+        pages_.insert (i, tabPage);
+        QString name = tabPage->textEdit()->getFileName().section ('/', -1);
+        names_.insert (i, name.isEmpty() ? tr ("Untitled") : name);
+    }
+    ++running_; // "Searching..." is shown while the snapshots are made
+    makeSnapshots();
+}
+/*************************/
+// The snapshots of outdated documents are made in time slices,
+// and the threads are started when all of them are ready.
+void SearchResults::makeSnapshots()
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < pages_.size(); ++i)
+    {
+        TabPage *tabPage = pages_.value (i);
+        if (tabPage == nullptr) continue; // the tab is closed
+        if (!tabPage->textEdit()->makeSnapshot (SNAPSHOT_SLICE - timer.elapsed()))
+        {
+            updateSummary();
+            snapshotTimer_->start (0);
+            return;
+        }
+    }
+    --running_;
+    startTabThreads();
+}
+/*************************/
+void SearchResults::startTabThreads()
+{
+    /* the snapshots are shared with the documents */
+    QList<int> tabIds;
+    QStringList texts;
+    for (int i = 0; i < pages_.size(); ++i)
+    {
+        if (TabPage *tabPage = pages_.value (i))
+        {
+            tabIds.append (i);
+            texts.append (tabPage->textEdit()->plainTextSnapshot());
+        }
+    }
+    if (texts.isEmpty())
+    {
+        updateSummary();
+        return;
+    }
+
+    /* give the largest documents to the least loaded threads */
+    QList<int> order;
+    for (int i = 0; i < texts.size(); ++i)
+        order.append (i);
+    std::sort (order.begin(), order.end(), [&texts] (int a, int b) {
+        return texts.at (a).length() > texts.at (b).length();
+    });
+    const int n = qBound (1, QThread::idealThreadCount(), texts.size());
+    QVector<qint64> loads (n, 0);
+    QVector<QList<int> > ids (n);
+    QVector<QStringList> threadTexts (n);
+    for (int i = 0; i < order.size(); ++i)
+    {
+        const int t = std::min_element (loads.constBegin(), loads.constEnd()) - loads.constBegin();
+        ids[t].append (tabIds.at (order.at (i)));
+        threadTexts[t].append (texts.at (order.at (i)));
+        loads[t] += texts.at (order.at (i)).length() + 1;
+    }
+
+    for (int t = 0; t < n; ++t)
+    {
+        if (!ids.at (t).isEmpty())
+            startThread (new Grepping (ids.at (t), threadTexts.at (t), str_, cs_, wholeWords_, regex_, generation_));
+    }
+    updateSummary();
+}
+/*************************/
+// The first thread lists the files, while the others search those that are listed.
+void SearchResults::searchFolder (const QString &dir, const QString &str,
+                                  Qt::CaseSensitivity cs, bool wholeWords, bool regex)
+{
+    if (!startSearch (str, cs, wholeWords, regex)) return;
+
+    dir_ = dir;
+    queue_ = QSharedPointer<GrepQueue> (new GrepQueue());
+    const int n = qMax (1, QThread::idealThreadCount());
+    for (int t = 0; t < n; ++t)
+        startThread (new Grepping (queue_, t == 0 ? dir : QString(), str, cs, wholeWords, regex, generation_));
+    updateSummary();
+}
+/*************************/
+// Document items are kept in the order of documents.
+QTreeWidgetItem *SearchResults::groupItem (int id)
+{
+    QTreeWidgetItem *item = groups_.value (id);
+    if (item) return item;
+    item = new QTreeWidgetItem();
+    item->setData (0, Qt::UserRole, id);
+    if (queue_)
+    {
+        const QString file = queue_->fileAt (id);
+        names_.insert (id, QDir (dir_).relativeFilePath (file));
+        item->setData (0, Qt::UserRole + 2, file);
+        item->setToolTip (0, file);
+    }
+    else if (TabPage *tabPage = pages_.value (id))
+        item->setToolTip (0, tabPage->textEdit()->getFileName());
+    QVector<int>::iterator it = std::lower_bound (groupIds_.begin(), groupIds_.end(), id);
+    tree_->insertTopLevelItem (it - groupIds_.begin(), item);
+    groupIds_.insert (it, id);
+    item->setExpanded (true);
+    groups_.insert (id, item);
+    return item;
+}
+/*************************/
+void SearchResults::onFound (int generation, int id, const QVector<int> lines, const QVector<int> columns,
+                             const QVector<int> lengths, const QStringList previews, bool more)
+{
+    if (generation != generation_) return; // an old result
+
+    QTreeWidgetItem *group = groupItem (id);
+    QList<QTreeWidgetItem*> children;
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        QTreeWidgetItem *child = new QTreeWidgetItem();
+        child->setText (0, QString ("%1: %2").arg (lines.at (i) + 1).arg (previews.at (i)));
+        child->setData (0, Qt::UserRole, lines.at (i));
+        child->setData (0, Qt::UserRole + 1, columns.at (i));
+        child->setData (0, Qt::UserRole + 2, lengths.at (i));
+        children.append (child);
+    }
+    group->addChildren (children);
+    if (more)
+    {
+        group->setData (0, Qt::UserRole + 1, true);
+        more_ = true;
+    }
+    group->setText (0, QString ("%1 (%2%3)").arg (names_.value (id))
+                                            .arg (group->childCount())
+                                            .arg (group->data (0, Qt::UserRole + 1).toBool() ? "+" : ""));
+    matches_ += lines.size();
+    updateSummary();
+}
+/*************************/
+void SearchResults::updateSummary()
+{
+    QString summary;
+    if (matches_ == 0 && !more_)
+        summary = running_ > 0 ? tr ("Searching...") : tr ("No match");
+    else
+    {
+        summary = tr ("%1 matches in %2 documents")
+                  .arg (more_ ? QString::number (matches_) + "+" : QString::number (matches_))
+                  .arg (groups_.size());
+        if (running_ > 0)
+            summary += " " + tr ("(searching...)");
+    }
+    label_->setText (summary);
+}
+/*************************/
+void SearchResults::onActivated (QTreeWidgetItem *item)
+{
+    QTreeWidgetItem *group = item->parent();
+    if (group == nullptr) return;
+    const QString file = group->data (0, Qt::UserRole + 2).toString();
+    if (!file.isEmpty())
+    {
+        emit fileResultActivated (file,
+                                  item->data (0, Qt::UserRole).toInt(),
+                                  item->data (0, Qt::UserRole + 1).toInt(),
+                                  item->data (0, Qt::UserRole + 2).toInt());
+        return;
+    }
+    TabPage *tabPage = pages_.value (group->data (0, Qt::UserRole).toInt());
+    if (tabPage == nullptr) return; // the tab is closed
+    emit tabResultActivated (tabPage,
+                             item->data (0, Qt::UserRole).toInt(),
+                             item->data (0, Qt::UserRole + 1).toInt(),
+                             item->data (0, Qt::UserRole + 2).toInt());
+}
+
+}
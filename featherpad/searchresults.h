@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef SEARCHRESULTS_H
+#define SEARCHRESULTS_H
+
+#include <QWidget>
+#include <QLabel>
+#include <QTreeWidget>
+#include <QPointer>
+#include <QHash>
+#include <QTimer>
+#include "tabpage.h"
+#include "grepping.h"
+
+namespace FeatherPad {
+
+/* A panel that shows the matches of a search in several documents or
+   in the files of a folder, grouped by document and with the lines of
+   the matches. The documents are searched in a few threads, on copies of
+   their texts, and their results are added as they arrive. */
+class SearchResults : public QWidget
+{
+    Q_OBJECT
+public:
+    SearchResults (QWidget *parent = nullptr);
+    ~SearchResults();
+
+    /* searches the texts of the pages (and cancels the previous search) */
+    void searchTabs (const QList<TabPage*> &pages, const QString &str,
+                     Qt::CaseSensitivity cs, bool wholeWords, bool regex);
+    /* searches the text files in the folder and its subfolders */
+    void searchFolder (const QString &dir, const QString &str,
+                       Qt::CaseSensitivity cs, bool wholeWords, bool regex);
+    void cancel();
+
+signals:
+    /* "line" is 0-based and may be outdated if the document has changed */
+    void tabResultActivated (TabPage *tabPage, int line, int column, int length);
+    void fileResultActivated (const QString &fileName, int line, int column, int length);
+
+private slots:
+    void onFound (int generation, int id, const QVector<int> lines, const QVector<int> columns,
+                  const QVector<int> lengths, const QStringList previews, bool more);
+    void onActivated (QTreeWidgetItem *item);
+    void makeSnapshots();
+
+private:
+    bool startSearch (const QString &str, Qt::CaseSensitivity cs, bool wholeWords, bool regex);
+    void startThread (Grepping *thread);
+    void startTabThreads();
+    QTreeWidgetItem *groupItem (int id);
+    void updateSummary();
+
+    QLabel *label_;
+    QTreeWidget *tree_;
+    QHash<int, QPointer<TabPage> > pages_;
+    QSharedPointer<GrepQueue> queue_; // the files of a folder search
+    QString dir_;
+    QHash<int, QString> names_;
+    QHash<int, QTreeWidgetItem*> groups_;
+    QVector<int> groupIds_; // the ids of the group items, in their order
+    /* the search of tabs, which waits for their snapshots */
+    QTimer *snapshotTimer_;
+    QString str_;
+    Qt::CaseSensitivity cs_;
+    bool wholeWords_;
+    bool regex_;
+    QList<QPointer<Grepping> > threads_;
+    int generation_;
+    int running_; // the number of working threads
+    int matches_;
+    bool more_; // some matches aren't shown
+};
+
+}
+
+#endif // SEARCHRESULTS_H
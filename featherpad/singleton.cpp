@@ -44,6 +44,7 @@ FPsingleton::FPsingleton (int &argc, char *argv[], const QString uniqueKey)
 #endif
 
     socketFailure_ = false;
+    frameStats_ = qgetenv ("FEATHERPAD_FRAME_STATS").isEmpty() ? nullptr : new FrameStats (this);
     config_.readConfig();
     lastFiles_ = config_.getLastFiles();
     if (config_.getIconless())
@@ -76,6 +77,7 @@ FPsingleton::FPsingleton (int &argc, char *argv[], const QString uniqueKey)
 /*************************/
 FPsingleton::~FPsingleton()
 {
+    delete frameStats_; // prints the percentiles of frame times
     config_.writeConfig();
 }
 /*************************/
@@ -25,6 +25,7 @@
 #include <QLocalServer>
 #include "fpwin.h"
 #include "config.h"
+#include "framestats.h"
 
 namespace FeatherPad {
 
@@ -67,6 +68,7 @@ private:
     QStringList lastFiles_;
     bool isX11_;
     bool socketFailure_;
+    FrameStats *frameStats_; // only for debugging
 };
 
 }
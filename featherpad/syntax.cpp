@@ -19,6 +19,7 @@
 
 #include "singleton.h"
 #include "ui_fp.h"
+#include "framestats.h"
 #include <QMimeDatabase>
 #include <QFileInfo>
 
@@ -236,8 +237,6 @@ void FPwin::syntaxHighlighting (TextEdit *textEdit, bool highlight)
         }
 
         Config config = static_cast<FPsingleton*>(qApp)->getConfig();
-        if (textEdit->getSize() > config.getMaxSHSize()*1024*1024)
-            return;
 
         if (!qobject_cast< Highlighter *>(textEdit->getHighlighter()))
         {
@@ -251,12 +250,13 @@ void FPwin::syntaxHighlighting (TextEdit *textEdit, bool highlight)
                                                         textEdit->hasDarkScheme(),
                                                         config.getShowWhiteSpace(),
                                                         config.getShowEndings());
+            /* huge texts are highlighted only around the viewport */
+            highlighter->setLazy (textEdit->getSize() > config.getMaxSHSize()*1024*1024);
             textEdit->setHighlighter (highlighter);
 
             QCoreApplication::processEvents(); // it's necessary to wait until the text is completely loaded
         }
         matchBrackets(); // in case the cursor is beside a bracket when the text is loaded
-        connect (textEdit, &TextEdit::updateBracketMatching, this, &FPwin::matchBrackets);
         /* visible text may change on block removal */
         connect (textEdit, &QPlainTextEdit::blockCountChanged, this, &FPwin::formatOnBlockChange);
         connect (textEdit, &TextEdit::updateRect, this, &FPwin::formatVisibleText);
@@ -270,7 +270,6 @@ void FPwin::syntaxHighlighting (TextEdit *textEdit, bool highlight)
         disconnect (textEdit, &TextEdit::resized, this, &FPwin::formatOnResizing);
         disconnect (textEdit, &TextEdit::updateRect, this, &FPwin::formatVisibleText);
         disconnect (textEdit, &QPlainTextEdit::blockCountChanged, this, &FPwin::formatOnBlockChange);
-        disconnect (textEdit, &TextEdit::updateBracketMatching, this, &FPwin::matchBrackets);
 
         /* remove bracket highlights */
         QList<QTextEdit::ExtraSelection> es = textEdit->extraSelections();
@@ -322,6 +321,7 @@ void FPwin::formatOnResizing() const
 /*************************/
 void FPwin::formatTextRect (QRect rect) const
 {
+    FrameTimer frameTimer (FrameStats::Format);
     if (TabPage *tabPage = qobject_cast<TabPage*>(ui->tabWidget->currentWidget()))
     {
         TextEdit *textEdit = tabPage->textEdit();
@@ -336,6 +336,8 @@ void FPwin::formatTextRect (QRect rect) const
         QTextCursor end = textEdit->cursorForPosition (Point);
 
         highlighter->setLimit (start, end);
+        /* the visible blocks may depend on the states of deferred ones */
+        highlighter->highlightDeferred (end.blockNumber());
         QTextBlock block = start.block();
         while (block.isValid() && block.blockNumber() <= end.blockNumber())
         {
@@ -19,6 +19,7 @@
 
 #include <QGridLayout>
 #include "tabpage.h"
+#include "searchindex.h"
 
 namespace FeatherPad {
 
@@ -58,6 +59,9 @@ TabPage::TabPage (ICONMODE iconMode, int bgColorValue,
 
     connect (searchBar_, &SearchBar::find, this, &TabPage::find);
     connect (searchBar_, &SearchBar::searchFlagChanged, this, &TabPage::searchFlagChanged);
+    /* show the number of matches while they're being found */
+    connect (textEdit_->getSearchIndex(), &SearchIndex::changed, this, &TabPage::updateMatchCount);
+    connect (textEdit_, &QPlainTextEdit::cursorPositionChanged, this, &TabPage::updateMatchCount);
 }
 /*************************/
 void TabPage::setSearchBarVisible (bool visible)
@@ -100,9 +104,37 @@ bool TabPage::matchWhole() const
     return searchBar_->matchWhole();
 }
 /*************************/
+bool TabPage::matchRegex() const
+{
+    return searchBar_->matchRegex();
+}
+/*************************/
 void TabPage::updateShortcuts (bool disable)
 {
     searchBar_->updateShortcuts (disable);
 }
+/*************************/
+// Shows "i of N" if a match is selected and "N" otherwise ("N+" while searching).
+void TabPage::updateMatchCount()
+{
+    SearchIndex *searchIndex = textEdit_->getSearchIndex();
+    if (!searchIndex->isActive())
+    {
+        searchBar_->setMatchCount (QString());
+        return;
+    }
+    const int count = searchIndex->count();
+    if (count == 0 && searchIndex->isComplete())
+    {
+        searchBar_->setMatchCount (tr ("No match"));
+        return;
+    }
+    QString total = QString::number (count);
+    if (!searchIndex->isComplete())
+        total += "+";
+    QTextCursor cursor = textEdit_->textCursor();
+    int n = searchIndex->matchNumber (cursor.selectionStart(), cursor.selectionEnd());
+    searchBar_->setMatchCount (n > 0 ? tr ("%1 of %2").arg (n).arg (total) : total);
+}
 
 }
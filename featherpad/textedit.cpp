@@ -19,17 +19,28 @@
 
 #include <QApplication>
 #include <QTimer>
-#include <QDateTime>
+#include <QWindow>
+#include <QScreen>
 #include <QPainter>
+#include <QtMath>
 #include "textedit.h"
 #include "vscrollbar.h"
+#include "bracketscanner.h"
+#include "searchindex.h"
+#include "framestats.h"
+#include "highlighter.h"
 
 #define UPDATE_INTERVAL 50 // in ms
 #define SCROLL_FRAMES_PER_SEC 60
 #define SCROLL_DURATION 300 // in ms
+#define MARKS_DELAY 100 // in ms
+#define MAX_FOLD_EDITS 32 // the edits after which all indented regions are forgotten
 
 namespace FeatherPad {
 
+/* the revisions of all documents are taken from here, so that they're unique */
+static int lastTextRevision = 0;
+
 TextEdit::TextEdit (QWidget *parent, int bgColorValue) : QPlainTextEdit (parent)
 {
     prevAnchor = prevPos = -1;
@@ -37,11 +48,15 @@ TextEdit::TextEdit (QWidget *parent, int bgColorValue) : QPlainTextEdit (parent)
     autoBracket = false;
     scrollJumpWorkaround = false;
     drawIndetLines = false;
+    guideTabWidth_ = guideLineSpacing_ = guideHeight_ = 0;
+    lineNumberAreaWidth_ = 0;
+    digitRatio_ = 0;
+    changingSelections_ = false;
     saveCursor_ = false;
 
     inertialScrolling_ = false;
-    wheelEvent_ = nullptr;
     scrollTimer_ = nullptr;
+    scrollPos_ = scrollTarget_ = 0;
 
     //document()->setUseDesignMetrics (true);
 
@@ -113,18 +128,114 @@ TextEdit::TextEdit (QWidget *parent, int bgColorValue) : QPlainTextEdit (parent)
     encoding_= "UTF-8";
     uneditable_ = false;
     highlighter_ = nullptr;
+    bracketScanner_ = new BracketScanner (document(), this);
+    bracketScanner_->setActive (true);
+    foldBlockCount_ = document()->blockCount();
+    foldGeneration_ = foldBaseGeneration_ = 0;
+    snapshotValid_ = false;
+    snapshotBlocks_ = 0;
+    textRevision_ = ++lastTextRevision;
+    marksTimer_ = new QTimer (this);
+    marksTimer_->setSingleShot (true);
+    marksTimer_->setInterval (MARKS_DELAY);
+    connect (marksTimer_, &QTimer::timeout, this, &TextEdit::updateScrollMarks);
+    searchIndex_ = new SearchIndex (this);
+    connect (searchIndex_, &SearchIndex::changed, marksTimer_, [this] {marksTimer_->start();});
     setFrameShape (QFrame::NoFrame);
     /* first we replace the widget's vertical scrollbar with ours because
        we want faster wheel scrolling when the mouse cursor is on the scrollbar */
     VScrollBar *vScrollBar = new VScrollBar;
     setVerticalScrollBar (vScrollBar);
+    connect (vScrollBar, &VScrollBar::grooveChanged, marksTimer_, [this] {marksTimer_->start();});
+    connect (vScrollBar, &QScrollBar::rangeChanged, marksTimer_, [this] {marksTimer_->start();});
 
     lineNumberArea = new LineNumberArea (this);
+    /* the paint event fills the whole rect; so, scroll() can move the painted rows */
+    lineNumberArea->setAttribute (Qt::WA_OpaquePaintEvent);
     lineNumberArea->hide();
 
+    if (FrameStats *stats = FrameStats::instance())
+        frameGraph_ = new FrameGraph (stats, this);
+    else
+        frameGraph_ = nullptr;
+
     connect (this, &QPlainTextEdit::updateRequest, this, &TextEdit::onUpdateRequesting);
     connect (this, &QPlainTextEdit::cursorPositionChanged, this, &TextEdit::updateBracketMatching);
     connect (this, &QPlainTextEdit::selectionChanged, this, &TextEdit::onSelectionChanged);
+    connect (this, &QPlainTextEdit::cursorPositionChanged, this, &TextEdit::unfoldAtCursor);
+    connect (document(), &QTextDocument::contentsChange, this, &TextEdit::onContentsChange);
+}
+/*************************/
+void TextEdit::setProg (const QString &prog)
+{
+    prog_ = prog;
+    bracketScanner_->setLanguage (prog == "help" ? QString() : prog);
+}
+/*************************/
+void TextEdit::setHighlighter (QSyntaxHighlighter *h)
+{
+    highlighter_ = h;
+    bracketScanner_->setActive (h == nullptr);
+}
+/*************************/
+const BracketIndex *TextEdit::getBracketIndex() const
+{
+    const BracketIndex *index = nullptr;
+    if (Highlighter *highlighter = qobject_cast< Highlighter *>(highlighter_))
+        index = &highlighter->getBracketIndex();
+    else if (bracketScanner_->isActive())
+        index = &bracketScanner_->getBracketIndex();
+    if (index && index->size() != document()->blockCount())
+        return nullptr; // not updated yet
+    return index;
+}
+/*************************/
+const QString &TextEdit::plainTextSnapshot()
+{
+    if (!snapshotValid_)
+    {
+        snapshot_ = plainTextRange (0, document()->characterCount() - 1);
+        snapshotValid_ = true;
+        snapshotBlocks_ = 0;
+    }
+    return snapshot_;
+}
+/*************************/
+// Block texts are joined by '\n' and keep non-breaking spaces,
+// like the selected text that plainTextSnapshot() uses.
+bool TextEdit::makeSnapshot (int msecs)
+{
+    if (snapshotValid_) return true;
+    QElapsedTimer timer;
+    timer.start();
+    if (snapshotBlocks_ == 0)
+    {
+        snapshot_.clear();
+        snapshot_.reserve (document()->characterCount());
+    }
+    QTextBlock block = document()->findBlockByNumber (snapshotBlocks_);
+    while (block.isValid())
+    {
+        if (snapshotBlocks_ > 0)
+            snapshot_ += QLatin1Char ('\n');
+        snapshot_ += block.text();
+        block = block.next();
+        if (++snapshotBlocks_ % 64 == 0 && block.isValid() && timer.elapsed() >= msecs)
+            return false;
+    }
+    snapshotValid_ = true;
+    snapshotBlocks_ = 0;
+    return true;
+}
+/*************************/
+QString TextEdit::plainTextRange (int from, int to) const
+{
+    QTextCursor cursor (document());
+    cursor.setPosition (from);
+    cursor.setPosition (to, QTextCursor::KeepAnchor);
+    QString text = cursor.selectedText();
+    text.replace (QChar::ParagraphSeparator, QLatin1Char ('\n'));
+    return text;
 }
 /*************************/
 void TextEdit::setEditorFont (const QFont &f)
@@ -170,6 +281,7 @@ void TextEdit::showLineNumbers (bool show)
         disconnect (this, &QPlainTextEdit::cursorPositionChanged, this, &TextEdit::highlightCurrentLine);
 
         lineNumberArea->hide();
+        lineNumberAreaWidth_ = 0;
         setViewportMargins (0, 0, 0, 0);
         QList<QTextEdit::ExtraSelection> es = extraSelections();
         if (!es.isEmpty() && !currentLine.cursor.isNull())
@@ -188,19 +300,28 @@ int TextEdit::lineNumberAreaWidth()
         ++digits;
     }
 
-    /* 4 = 2 + 2 (-> lineNumberAreaPaintEvent) */
-    int space = 4 + fontMetrics().width (QLatin1Char ('9')) * digits;
+    /* 4 = 2 + 2 (-> lineNumberAreaPaintEvent) and the fold marker comes at the left */
+    int space = 4 + fontMetrics().width (QLatin1Char ('9')) * digits
+                + fontMetrics().height() / 2 + 2;
 
     return space;
 }
 /*************************/
+// Because this is called on every scroll step, the viewport
+// margins are changed only when the width really changes.
 void TextEdit::updateLineNumberAreaWidth (int /* newBlockCount */)
 {
-    setViewportMargins (lineNumberAreaWidth(), 0, 0, 0);
+    int w = lineNumberAreaWidth();
+    if (w == lineNumberAreaWidth_) return;
+    lineNumberAreaWidth_ = w;
+    setViewportMargins (w, 0, 0, 0);
 }
 /*************************/
 void TextEdit::updateLineNumberArea (const QRect &rect, int dy)
 {
+    if (changingSelections_) return; // line numbers aren't affected by extra selections
+
+    /* the line number area is opaque; so, only the exposed rows are repainted */
     if (dy)
         lineNumberArea->scroll (0, dy);
     else
@@ -597,69 +718,75 @@ void TextEdit::wheelEvent (QWheelEvent *event)
 
         if (QScrollBar* vbar = verticalScrollBar())
         {
-            /* always set the initial speed to 3 lines per wheel turn */
-            int delta = event->angleDelta().y() * 3 / QApplication::wheelScrollLines();
-            if((delta > 0 && vbar->value() == vbar->minimum())
-               || (delta < 0 && vbar->value() == vbar->maximum()))
+            /* 3 lines per wheel turn */
+            qreal delta = -event->angleDelta().y() * 3 / 120.0;
+            if((delta < 0 && vbar->value() == vbar->minimum())
+               || (delta > 0 && vbar->value() == vbar->maximum()))
             {
                 return; // the scrollbar can't move
             }
-            /* keep track of the wheel event */
-            wheelEvent_ = event;
-            /* find the number of wheel events in 500 ms
-               and set the scroll frames per second accordingly */
-            static QList<qint64> wheelEvents;
-            wheelEvents << QDateTime::currentMSecsSinceEpoch();
-            while (wheelEvents.last() - wheelEvents.first() > 500)
-                wheelEvents.removeFirst();
-            int fps = qMax (SCROLL_FRAMES_PER_SEC / wheelEvents.size(), 5);
-
-            /* set the data for inertial scrolling */
-            scollData data;
-            data.delta = delta;
-            data.totalSteps = data.leftSteps = fps * SCROLL_DURATION / 1000;
-            queuedScrollSteps_.append (data);
+
             if (!scrollTimer_)
             {
                 scrollTimer_ = new QTimer();
                 scrollTimer_->setTimerType (Qt::PreciseTimer);
                 connect (scrollTimer_, &QTimer::timeout, this, &TextEdit::scrollWithInertia);
             }
-            scrollTimer_->start (1000 / SCROLL_FRAMES_PER_SEC);
+            if (!scrollTimer_->isActive()
+                || (delta > 0) != (scrollTarget_ > scrollPos_)) // the direction is changed
+            {
+                scrollPos_ = scrollTarget_ = vbar->value();
+            }
+            scrollTarget_ = qBound ((qreal) vbar->minimum(), scrollTarget_ + delta, (qreal) vbar->maximum());
+            if (!scrollTimer_->isActive())
+            {
+                /* a frame per refresh of the screen */
+                int fps = SCROLL_FRAMES_PER_SEC;
+                if (QWindow *win = window()->windowHandle())
+                {
+                    if (win->screen() && win->screen()->refreshRate() >= 1)
+                        fps = qRound (win->screen()->refreshRate());
+                }
+                scrollClock_.start();
+                scrollTimer_->start (qMax (1000 / fps, 1));
+            }
         }
     }
 }
 /*************************/
+// The position approaches the target exponentially, by the time passed since
+// the previous frame, so that the speed doesn't depend on the timer's accuracy.
+// The scrollbar is set directly, and formatting and highlighting the text
+// are postponed until the scrolling is finished (-> onUpdateRequesting).
 void TextEdit::scrollWithInertia()
 {
-    if (!wheelEvent_ || !verticalScrollBar()) return;
+    QScrollBar *vbar = verticalScrollBar();
+    if (!vbar || vbar->value() != qRound (scrollPos_))
+    { // the scrollbar is moved in another way
+        stopInertialScrolling();
+        return;
+    }
 
-    int totalDelta = 0;
-    for (QList<scollData>::iterator it = queuedScrollSteps_.begin(); it != queuedScrollSteps_.end(); ++it)
+    const qreal dt = scrollClock_.restart();
+    scrollPos_ += (scrollTarget_ - scrollPos_) * (1 - qExp (-3 * dt / SCROLL_DURATION));
+    if (qAbs (scrollTarget_ - scrollPos_) < 0.5)
     {
-        totalDelta += qRound ((qreal)it->delta / (qreal)it->totalSteps);
-        -- it->leftSteps;
+        vbar->setValue (qRound (scrollTarget_));
+        stopInertialScrolling();
+        return;
     }
-    /* only remove the first queue to simulate an inertia */
-    while (!queuedScrollSteps_.empty())
-    {
-        int t = queuedScrollSteps_.begin()->totalSteps; // 18 for one wheel turn
-        int l = queuedScrollSteps_.begin()->leftSteps;
-        if ((t > 10 && l <= 0)
-            || (t > 5 && t <= 10 && l <= -3)
-            || (t <= 5 && l <= -6))
-        {
-            queuedScrollSteps_.removeFirst();
-        }
-        else break;
+    vbar->setValue (qRound (scrollPos_));
+}
+/*************************/
+void TextEdit::stopInertialScrolling()
+{
+    scrollTimer_->stop();
+    scrollPos_ = scrollTarget_ = verticalScrollBar() ? verticalScrollBar()->value() : 0;
+    if (updateTimerId)
+    { // emit the postponed update request
+        killTimer (updateTimerId);
+        updateTimerId = startTimer (0);
     }
-    /* -> qevent.cpp -> QWheelEvent::QWheelEvent() */
-    QWheelEvent e (wheelEvent_->pos(), wheelEvent_->globalPos(),
-                   totalDelta,
-                   wheelEvent_->buttons(), Qt::NoModifier, Qt::Vertical);
-    QCoreApplication::sendEvent (verticalScrollBar(), &e);
-    if (queuedScrollSteps_.empty())
-        scrollTimer_->stop();
 }
 /*************************/
 void TextEdit::resizeEvent (QResizeEvent *e)
@@ -668,6 +795,11 @@ void TextEdit::resizeEvent (QResizeEvent *e)
 
     QRect cr = contentsRect();
     lineNumberArea->setGeometry (QRect (cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
+    if (frameGraph_)
+    { // at the top right corner of the viewport
+        frameGraph_->move (viewport()->geometry().right() - frameGraph_->width(), viewport()->geometry().top());
+        frameGraph_->raise();
+    }
 
     if (resizeTimerId)
     {
@@ -677,6 +809,76 @@ void TextEdit::resizeEvent (QResizeEvent *e)
     resizeTimerId = startTimer (UPDATE_INTERVAL);
 }
 /*************************/
+// The number of whitespaces at the start of a block, which is
+// found once for each block and forgotten when the block changes.
+int TextEdit::blockIndentation (const QTextBlock &block)
+{
+    const int count = document()->blockCount();
+    if (indents_.size() != count)
+        indents_.fill (-1, count);
+    int &indent = indents_[block.blockNumber()];
+    if (indent < 0)
+    {
+        const QString text = block.text();
+        int i = 0;
+        while (i < text.length() && text.at (i).isSpace())
+            ++i;
+        indent = i;
+    }
+    return indent;
+}
+/*************************/
+// The metrics of indentation lines are found only when the font changes.
+void TextEdit::updateGuideMetrics()
+{
+    const QFont f = document()->defaultFont();
+    if (f == guideFont_ && guideTabWidth_ > 0) return;
+    guideFont_ = f;
+    QFontMetricsF fm (f);
+    guideTabWidth_ = fm.width ("    ");
+    guideLineSpacing_ = fm.lineSpacing();
+    guideHeight_ = fm.height();
+}
+/*************************/
+// Renders the digits of line numbers into pixmaps, so that drawing a line number
+// is only copying a few pixmaps and doesn't need any text layout.
+void TextEdit::updateDigitPixmaps()
+{
+    const QFont f = lineNumberArea->font();
+#if QT_VERSION >= 0x050600
+    const qreal ratio = lineNumberArea->devicePixelRatioF();
+#else
+    const qreal ratio = lineNumberArea->devicePixelRatio();
+#endif
+    const QColor bg (darkScheme ? Qt::lightGray : Qt::black);
+    if (f == digitFont_ && ratio == digitRatio_ && bg == digitBackground_ && !digitPixmaps_.isEmpty())
+        return;
+    digitFont_ = f;
+    digitRatio_ = ratio;
+    digitBackground_ = bg;
+    digitPixmaps_.clear();
+    digitWidths_.clear();
+
+    QFontMetrics fm (f);
+    const int h = fm.height();
+    for (int i = 0; i < 10; ++i)
+    {
+        const QChar digit = QLatin1Char ('0' + i);
+        const int w = fm.width (digit);
+        /* an opaque background keeps subpixel antialiasing */
+        QPixmap pix (qMax (1, qCeil (w * ratio)), qMax (1, qCeil (h * ratio)));
+        pix.setDevicePixelRatio (ratio);
+        pix.fill (bg);
+        QPainter p (&pix);
+        p.setFont (f);
+        p.setPen (darkScheme ? Qt::black : Qt::white);
+        p.drawText (0, fm.ascent(), QString (digit));
+        p.end();
+        digitPixmaps_.append (pix);
+        digitWidths_.append (w);
+    }
+}
+/*************************/
 void TextEdit::timerEvent (QTimerEvent *e)
 {
     QPlainTextEdit::timerEvent (e);
@@ -719,9 +921,10 @@ static void fillBackground (QPainter *p, const QRectF &rect, QBrush brush, const
 }
 // Exactly like QPlainTextEdit::paintEvent(),
 // except for setting layout text option for RTL
-// and drawing vertical indentation lines (if needed).
+// and drawing vertical indentation lines (if needed) and fold marks.
 void TextEdit::paintEvent (QPaintEvent *event)
 {
+    FrameTimer frameTimer (FrameStats::Paint);
     QPainter painter (viewport());
     Q_ASSERT (qobject_cast<QPlainTextDocumentLayout*>(document()->documentLayout()));
 
@@ -739,6 +942,9 @@ void TextEdit::paintEvent (QPaintEvent *event)
 
     bool editable = !isReadOnly();
     QAbstractTextDocumentLayout::PaintContext context = getPaintContext();
+    QVector<QLine> guides; // indentation lines, which are drawn together
+    if (drawIndetLines)
+        updateGuideMetrics();
     QTextBlock block = firstVisibleBlock();
     while (block.isValid())
     {
@@ -847,58 +1053,83 @@ void TextEdit::paintEvent (QPaintEvent *event)
             }
 
             /* indentation lines should be drawn after selections */
-            if (drawIndetLines)
+            if (drawIndetLines && layout->lineCount() > 0)
             {
-                QRegExp exp = QRegExp ("\\s+");
-                if (exp.indexIn (block.text()) == 0)
+                const int indent = blockIndentation (block);
+                if (indent > 0)
                 {
-                    QRegExp exp = QRegExp ("\\s+");
-                    if (exp.indexIn (block.text()) == 0)
+                    QTextLine line = layout->lineForTextPosition (indent);
+                    if (!line.isValid())
+                        line = layout->lineAt (layout->lineCount() - 1);
+                    /* the x-coordinate of the cursor at the end of the indentation */
+                    qreal cursorX = offset.x() + layout->position().x() + line.cursorToX (indent);
+                    int yTop = qRound (r.topLeft().y());
+                    int yBottom =  qRound (r.height() >= (qreal)2 * guideLineSpacing_
+                                               ? yTop + guideHeight_
+                                               : r.bottomLeft().y() - (qreal)1);
+                    if (rtl)
                     {
-                        painter.save();
-                        painter.setOpacity (0.18);
-                        QTextCursor cur = textCursor();
-                        cur.setPosition (exp.matchedLength() + block.position());
-                        QFontMetricsF fm = QFontMetricsF (document()->defaultFont());
-                        int yTop = qRound (r.topLeft().y());
-                        int yBottom =  qRound (r.height() >= (qreal)2 * fm.lineSpacing()
-                                                   ? yTop + fm.height()
-                                                   : r.bottomLeft().y() - (qreal)1);
-                        qreal tabWidth = (qreal)fm.width ("    ");
-                        if (rtl)
+                        qreal x = r.topRight().x() - guideTabWidth_;
+                        while (x >= cursorX)
                         {
-                            qreal leftMost = cursorRect (cur).left();
-                            qreal x = r.topRight().x();
-                            x -= tabWidth;
-                            while (x >= leftMost)
-                            {
-                                painter.drawLine (QLine (qRound (x), yTop, qRound (x), yBottom));
-                                x -= tabWidth;
-                            }
+                            guides.append (QLine (qRound (x), yTop, qRound (x), yBottom));
+                            x -= guideTabWidth_;
                         }
-                        else
+                    }
+                    else
+                    {
+                        qreal x = r.topLeft().x() + guideTabWidth_;
+                        while (x <= cursorX)
                         {
-                            qreal rightMost = cursorRect (cur).right();
-                            qreal x = r.topLeft().x();
-                            x += tabWidth;
-                            while (x <= rightMost)
-                            {
-                                painter.drawLine (QLine (qRound (x), yTop, qRound (x), yBottom));
-                                x += tabWidth;
-                            }
+                            guides.append (QLine (qRound (x), yTop, qRound (x), yBottom));
+                            x += guideTabWidth_;
                         }
-                        painter.restore();
                     }
                 }
             }
+
+            /* show that the block is folded */
+            if (!folds_.isEmpty() && folds_.contains (block.blockNumber()) && layout->lineCount() > 0)
+            {
+                QTextLine line = layout->lineAt (layout->lineCount() - 1);
+                QRectF lineRect = line.naturalTextRect().translated (r.topLeft());
+                QFontMetricsF fm = QFontMetricsF (document()->defaultFont());
+                qreal w = fm.width ("...") + 4;
+                qreal x = rtl ? lineRect.left() - fm.width (' ') - w
+                              : lineRect.right() + fm.width (' ');
+                QRectF markRect (x, lineRect.top() + 1, w, line.height() - 2);
+                painter.save();
+                painter.setPen (darkScheme ? Qt::gray : Qt::darkGray);
+                painter.drawRoundedRect (markRect, 3, 3);
+                painter.drawText (markRect, Qt::AlignCenter, "...");
+                painter.restore();
+            }
         }
 
         offset.ry() += r.height();
         if (offset.y() > viewportRect.height())
             break;
+        if (!folds_.isEmpty())
+        { // jump over the hidden blocks of a folded region
+            QMap<int, int>::const_iterator fold = folds_.constFind (block.blockNumber());
+            if (fold != folds_.constEnd())
+            {
+                QTextBlock last = document()->findBlockByNumber (fold.value());
+                if (last.isValid())
+                    block = last;
+            }
+        }
         block = block.next();
     }
 
+    if (!guides.isEmpty())
+    {
+        painter.save();
+        painter.setOpacity (0.18);
+        painter.drawLines (guides);
+        painter.restore();
+    }
+
     if (backgroundVisible() && !block.isValid() && offset.y() <= er.bottom()
         && (centerOnScroll() || verticalScrollBar()->maximum() == verticalScrollBar()->minimum()))
     {
@@ -927,6 +1158,7 @@ void TextEdit::highlightCurrentLine()
 /*************************/
 void TextEdit::lineNumberAreaPaintEvent (QPaintEvent *event)
 {
+    FrameTimer frameTimer (FrameStats::LineNumbers);
     QPainter painter (lineNumberArea);
     painter.fillRect (event->rect(), darkScheme ? Qt::lightGray : Qt::black);
 
@@ -935,17 +1167,52 @@ void TextEdit::lineNumberAreaPaintEvent (QPaintEvent *event)
     int blockNumber = block.blockNumber();
     int top = (int) blockBoundingGeometry (block).translated (contentOffset()).top();
     int bottom = top + (int) blockBoundingRect (block).height();
+    int h = fontMetrics().height();
+    int markerSize = h / 2;
+    updateDigitPixmaps();
 
     while (block.isValid() && top <= event->rect().bottom())
     {
+        QMap<int, int>::const_iterator fold = folds_.constEnd();
         if (block.isVisible() && bottom >= event->rect().top())
         {
-            QString number = QString::number (blockNumber + 1);
-            painter.setPen (darkScheme ? Qt::black : Qt::white);
-            painter.drawText (0, top, lineNumberArea->width() - 2, fontMetrics().height(),
-                              Qt::AlignRight, number);
+            /* draw the line number from right to left */
+            int right = lineNumberArea->width() - 2;
+            int number = blockNumber + 1;
+            do {
+                const int d = number % 10;
+                right -= digitWidths_.at (d);
+                painter.drawPixmap (right, top, digitPixmaps_.at (d));
+                number /= 10;
+            } while (number > 0);
+
+            /* draw a triangle for folded and foldable blocks */
+            fold = folds_.constFind (blockNumber);
+            bool folded (fold != folds_.constEnd());
+            if (folded || isFoldable (block))
+            {
+                painter.save();
+                painter.setRenderHint (QPainter::Antialiasing);
+                painter.setPen (Qt::NoPen);
+                painter.setBrush (folded ? QColor (Qt::red)
+                                         : darkScheme ? QColor (Qt::darkGray) : QColor (Qt::gray));
+                int x = 1;
+                int y = top + (h - markerSize) / 2;
+                QPolygon triangle;
+                if (folded) // pointing right
+                    triangle << QPoint (x, y) << QPoint (x + markerSize, y + markerSize / 2) << QPoint (x, y + markerSize);
+                else // pointing down
+                    triangle << QPoint (x, y) << QPoint (x + markerSize, y) << QPoint (x + markerSize / 2, y + markerSize);
+                painter.drawPolygon (triangle);
+                painter.restore();
+            }
         }
 
+        if (fold != folds_.constEnd())
+        { // jump over the hidden blocks
+            blockNumber = fold.value();
+            block = document()->findBlockByNumber (blockNumber);
+        }
         block = block.next();
         top = bottom;
         bottom = top + (int)blockBoundingRect (block).height();
@@ -953,6 +1220,389 @@ void TextEdit::lineNumberAreaPaintEvent (QPaintEvent *event)
     }
 }
 /*************************/
+void TextEdit::lineNumberAreaMousePressEvent (QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) return;
+    QTextBlock block = cursorForPosition (QPoint (0, event->pos().y())).block();
+    if (toggleFold (block))
+        event->accept();
+}
+/*************************/
+// The number of braces that are opened in a block but not closed in it.
+static int unclosedBraces (const QTextBlock &block)
+{
+    int open = 0;
+    if (TextBlockData *data = static_cast<TextBlockData *>(block.userData()))
+    {
+        const TextBlockData::BraceList &braces = data->braces();
+        for (int i = 0; i < braces.size(); ++i)
+        {
+            if (braces.at (i).character == '{')
+                ++open;
+            else if (open > 0)
+                --open;
+        }
+    }
+    return open;
+}
+/*************************/
+// Returns the last block of the region that can be folded at "block" (-1 if none).
+// Braces come first and then indentation.
+int TextEdit::foldEnd (const QTextBlock &block)
+{
+    if (!block.isValid()) return -1;
+    int bn = block.blockNumber();
+
+    int open = unclosedBraces (block);
+    if (open > 0)
+    {
+        if (const BracketIndex *index = getBracketIndex())
+        { // find where the first unclosed brace is closed and leave that block visible
+            int end = index->forwardMatch (bn, BracketIndex::Brace, open - 1);
+            if (end > bn + 1)
+                return end - 1;
+            if (end == bn + 1)
+                return -1;
+        }
+    }
+
+    return indentationFoldEnd (block);
+}
+/*************************/
+// Returns the last block of the region after "block" that is indented more than it
+// (-1 if none). The results are kept until the text changes (see onContentsChange),
+// and the known regions of inner blocks are jumped over because they are indented
+// more too. Empty lines don't count.
+int TextEdit::indentationFoldEnd (const QTextBlock &block)
+{
+    const int count = document()->blockCount();
+    if (foldEnds_.size() != count)
+    {
+        const FoldEnd unknown = {-1, 0};
+        foldEnds_.fill (unknown, count);
+        foldEdits_.clear();
+    }
+    const int bn = block.blockNumber();
+    int end = cachedFoldEnd (bn);
+    if (end != -2)
+        return end;
+
+    end = -1;
+    const int indent = blockIndentation (block);
+    if (indent < block.length() - 1) // not an empty line
+    {
+        int n = bn + 1;
+        QTextBlock next = block.next();
+        while (next.isValid())
+        {
+            const int i = blockIndentation (next);
+            if (i < next.length() - 1)
+            {
+                if (i <= indent) break;
+                end = n;
+                const int innerEnd = cachedFoldEnd (n);
+                if (innerEnd > n)
+                {
+                    end = n = innerEnd;
+                    next = document()->findBlockByNumber (n);
+                }
+            }
+            next = next.next();
+            ++n;
+        }
+    }
+    FoldEnd &f = foldEnds_[bn];
+    f.length = end > bn ? end - bn : 0;
+    f.generation = foldGeneration_;
+    return end;
+}
+/*************************/
+// Returns the known end of the indented region after a block (-1 if none),
+// or -2 if it isn't known or an edit after finding it may have changed it.
+int TextEdit::cachedFoldEnd (int blockNumber) const
+{
+    const FoldEnd &f = foldEnds_.at (blockNumber);
+    if (f.length < 0 || f.generation < foldBaseGeneration_)
+        return -2;
+    if (f.length == 0)
+        return -1;
+    const int end = blockNumber + f.length;
+    for (int i = 0; i < foldEdits_.size(); ++i)
+    {
+        const QPair<int, int> &edit = foldEdits_.at (i);
+        if (edit.second > f.generation && blockNumber < edit.first && end >= edit.first)
+            return -2; // the region reaches the edit
+    }
+    return end;
+}
+/*************************/
+// Since indentations and indented regions are cached, this is cheap enough
+// to be called for every visible block when the line numbers are painted.
+bool TextEdit::isFoldable (const QTextBlock &block)
+{
+    if (!block.isValid()) return false;
+    return unclosedBraces (block) > 0
+           || indentationFoldEnd (block) > block.blockNumber();
+}
+/*************************/
+bool TextEdit::toggleFold (const QTextBlock &block)
+{
+    if (!block.isValid()) return false;
+    int bn = block.blockNumber();
+    QMap<int, int>::iterator it = folds_.find (bn);
+    if (it != folds_.end())
+    {
+        int end = it.value();
+        folds_.erase (it);
+        updateFoldVisibility (bn + 1, end);
+        return true;
+    }
+
+    int end = foldEnd (block);
+    if (end <= bn) return false;
+    /* folded regions should be nested or disjoint */
+    QMap<int, int>::const_iterator f;
+    for (f = folds_.lowerBound (bn + 1); f != folds_.constEnd() && f.key() <= end; ++f)
+    {
+        if (f.value() > end) return false;
+    }
+    for (f = folds_.constBegin(); f != folds_.constEnd() && f.key() < bn; ++f)
+    {
+        if (f.value() >= bn && f.value() < end) return false;
+    }
+
+    folds_.insert (bn, end);
+    updateFoldVisibility (bn + 1, end);
+
+    if (!textCursor().block().isVisible())
+    { // move the cursor to the start of the folded region
+        QTextCursor cur = textCursor();
+        cur.setPosition (block.position());
+        setTextCursor (cur);
+    }
+    return true;
+}
+/*************************/
+void TextEdit::unfoldAll()
+{
+    if (folds_.isEmpty()) return;
+    int first = folds_.constBegin().key() + 1;
+    int last = first;
+    for (QMap<int, int>::const_iterator it = folds_.constBegin(); it != folds_.constEnd(); ++it)
+        last = qMax (last, it.value());
+    folds_.clear();
+    updateFoldVisibility (first, last);
+}
+/*************************/
+// Makes the blocks from "first" to "last" visible, except for those inside folded regions.
+void TextEdit::updateFoldVisibility (int first, int last)
+{
+    last = qMin (last, document()->blockCount() - 1);
+    if (first > last) return;
+
+    /* the folded regions that contain the first block */
+    int hiddenUntil = -1;
+    for (QMap<int, int>::const_iterator it = folds_.constBegin();
+         it != folds_.constEnd() && it.key() < first; ++it)
+    {
+        if (it.value() >= first)
+            hiddenUntil = qMax (hiddenUntil, it.value());
+    }
+
+    QTextBlock firstBlock = document()->findBlockByNumber (first);
+    QTextBlock block = firstBlock;
+    QTextBlock lastBlock = block;
+    int n = first;
+    while (block.isValid() && n <= last)
+    {
+        bool visible (n > hiddenUntil);
+        if (block.isVisible() != visible)
+            block.setVisible (visible);
+        QMap<int, int>::const_iterator it = folds_.constFind (n);
+        if (it != folds_.constEnd())
+            hiddenUntil = qMax (hiddenUntil, it.value());
+        lastBlock = block;
+        block = block.next();
+        ++n;
+    }
+
+    /* relayout the blocks (invisible blocks have no height) */
+    document()->markContentsDirty (firstBlock.position(),
+                                   lastBlock.position() + lastBlock.length() - firstBlock.position());
+    viewport()->update();
+    lineNumberArea->update();
+}
+/*************************/
+// Shifts the folded regions when blocks are added or removed
+// and unfolds the regions whose contents are changed.
+void TextEdit::onContentsChange (int pos, int charsRemoved, int charsAdded)
+{
+    if (charsRemoved > 0 || charsAdded > 0)
+    {
+        textRevision_ = ++lastTextRevision;
+        snapshotValid_ = false;
+        snapshotBlocks_ = 0;
+        snapshot_.clear();
+    }
+
+    int count = document()->blockCount();
+    int delta = count - foldBlockCount_;
+    foldBlockCount_ = count;
+    if (charsRemoved == 0 && charsAdded == 0) return;
+
+    int first = document()->findBlock (pos).blockNumber();
+    int last = qMax (first, document()->findBlock (pos + charsAdded).blockNumber());
+
+    /* shift the known indentations and forget those of the changed blocks */
+    if (!indents_.isEmpty())
+    {
+        if (delta > 0)
+            indents_.insert (qMin (first + 1, indents_.size()), delta, -1);
+        else if (delta < 0)
+            indents_.remove (first + 1, qMin (-delta, indents_.size() - first - 1));
+        if (indents_.size() != count)
+            indents_.clear();
+        else
+        {
+            for (int i = first; i <= last && i < count; ++i)
+                indents_[i] = -1;
+        }
+    }
+
+    /* Forget the indented regions that may have changed: the regions of the
+       changed blocks and of the empty blocks before them, as well as the region
+       of the last non-empty block before them ("prev"). The regions after the
+       changed blocks are kept with their lengths and the regions that reach
+       "prev" are found lazily (see cachedFoldEnd), so that an edit doesn't
+       touch all of the blocks. */
+    if (!foldEnds_.isEmpty())
+    {
+        const FoldEnd unknown = {-1, 0};
+        if (delta > 0)
+            foldEnds_.insert (qMin (first + 1, foldEnds_.size()), delta, unknown);
+        else if (delta < 0)
+            foldEnds_.remove (first + 1, qMin (-delta, foldEnds_.size() - first - 1));
+        if (foldEnds_.size() != count)
+        {
+            foldEnds_.clear();
+            foldEdits_.clear();
+        }
+        else
+        {
+            int prev = first - 1;
+            QTextBlock block = document()->findBlockByNumber (prev);
+            while (block.isValid() && blockIndentation (block) == block.length() - 1)
+            {
+                block = block.previous();
+                --prev;
+            }
+            for (int i = qMax (prev, 0); i <= last && i < count; ++i)
+                foldEnds_[i] = unknown;
+
+            ++foldGeneration_;
+            for (int i = 0; i < foldEdits_.size(); ++i)
+            {
+                int &edit = foldEdits_[i].first;
+                if (edit > first)
+                    edit = qMax (first, edit + delta);
+            }
+            if (prev >= 0)
+            {
+                if (foldEdits_.size() >= MAX_FOLD_EDITS)
+                { // forget all regions instead of checking more edits
+                    foldBaseGeneration_ = foldGeneration_;
+                    foldEdits_.clear();
+                }
+                else
+                    foldEdits_.append (qMakePair (prev, foldGeneration_));
+            }
+        }
+    }
+
+    if (folds_.isEmpty()) return;
+    QMap<int, int> shifted;
+    QList<QPair<int, int> > broken;
+    for (QMap<int, int>::const_iterator it = folds_.constBegin(); it != folds_.constEnd(); ++it)
+    {
+        int start = it.key();
+        int end = it.value();
+        if (start > first)
+            start += delta;
+        if (end > first)
+            end += delta;
+        if ((start <= last && end >= first) || end <= start)
+            broken << qMakePair (start, end);
+        else
+            shifted.insert (start, end);
+    }
+    folds_ = shifted;
+    for (int i = 0; i < broken.size(); ++i)
+        updateFoldVisibility (qMax (broken.at (i).first + 1, 0), broken.at (i).second);
+}
+/*************************/
+void TextEdit::unfoldAtCursor()
+{
+    if (folds_.isEmpty()) return;
+    QTextBlock block = textCursor().block();
+    if (block.isVisible()) return;
+
+    int bn = block.blockNumber();
+    int first = -1, last = -1;
+    QMap<int, int>::iterator it = folds_.begin();
+    while (it != folds_.end() && it.key() < bn)
+    {
+        if (it.value() >= bn)
+        {
+            if (first == -1) first = it.key() + 1;
+            last = qMax (last, it.value());
+            it = folds_.erase (it);
+        }
+        else
+            ++it;
+    }
+    if (first >= 0)
+        updateFoldVisibility (first, last);
+}
+/*************************/
+// Puts the marks of the known search matches, replacements and bracket matches
+// into the pixels of the scrollbar groove. A line is found only once for all
+// marks in its block, which is enough because the search matches are sorted.
+void TextEdit::updateScrollMarks()
+{
+    VScrollBar *vScrollBar = qobject_cast<VScrollBar*>(verticalScrollBar());
+    if (vScrollBar == nullptr) return;
+    const QVector<int> &positions = searchIndex_->positions();
+    const int length = vScrollBar->grooveLength();
+    if (length <= 0 || (positions.isEmpty() && greenSel_.isEmpty() && redSel_.isEmpty()))
+    {
+        vScrollBar->setMarks (QVector<uchar>());
+        return;
+    }
+
+    QVector<uchar> marks (length, 0);
+    /* the scrollbar range is in lines */
+    const qint64 total = qMax (1, vScrollBar->maximum() + vScrollBar->pageStep());
+    QTextDocument *doc = document();
+    QTextBlock block;
+    int y = 0;
+    auto mark = [&] (int pos, uchar m) {
+        if (!block.isValid() || pos < block.position() || pos >= block.position() + block.length())
+        {
+            block = doc->findBlock (pos);
+            if (!block.isValid()) return;
+            y = qMin (static_cast<qint64>(length - 1), block.firstLineNumber() * length / total);
+        }
+        marks[y] |= m;
+    };
+    for (int i = 0; i < positions.size(); ++i)
+        mark (positions.at (i), VScrollBar::SearchMark);
+    for (int i = 0; i < greenSel_.size(); ++i)
+        mark (greenSel_.at (i).cursor.selectionStart(), VScrollBar::ReplaceMark);
+    for (int i = 0; i < redSel_.size(); ++i)
+        mark (redSel_.at (i).cursor.selectionStart(), VScrollBar::BracketMark);
+    vScrollBar->setMarks (marks);
+}
+/*************************/
 // This calls the private function _q_adjustScrollbars()
 // by calling QPlainTextEdit::resizeEvent().
 void TextEdit::adjustScrollbars()
@@ -973,6 +1623,11 @@ void TextEdit::onUpdateRequesting (const QRect& /*rect*/, int dy)
     }
     else Dy = dy;
 
+    if (scrollTimer_ && scrollTimer_->isActive())
+    { // wait until the inertial scrolling is finished (-> stopInertialScrolling)
+        updateTimerId = startTimer (UPDATE_INTERVAL * 20); // just a precaution
+        return;
+    }
     updateTimerId = startTimer (UPDATE_INTERVAL);
 }
 /*************************/
@@ -23,9 +23,18 @@
 #include <QPlainTextEdit>
 #include <QMimeData>
 #include <QSyntaxHighlighter>
+#include <QMap>
+#include <QTimer>
+#include <QPixmap>
+#include <QElapsedTimer>
+#include "blockcache.h"
 
 namespace FeatherPad {
 
+class BracketScanner;
+class BracketIndex;
+class SearchIndex;
+
 /* This is for auto-indentation, line numbers, DnD, zooming, customized
    vertical scrollbar, appropriate signals, and saving/getting useful info. */
 class TextEdit : public QPlainTextEdit
@@ -46,6 +55,7 @@ public:
     void setEditorFont (const QFont &f);
 
     void lineNumberAreaPaintEvent (QPaintEvent *event);
+    void lineNumberAreaMousePressEvent (QMouseEvent *event);
     int lineNumberAreaWidth();
     void showLineNumbers (bool show);
 
@@ -116,9 +126,7 @@ public:
     QString getProg() const {
         return prog_;
     }
-    void setProg (QString prog) {
-        prog_ = prog;
-    }
+    void setProg (const QString &prog);
 
     QString getEncoding() const {
         return encoding_;
@@ -132,12 +140,21 @@ public:
     }
     void setGreenSel (QList<QTextEdit::ExtraSelection> sel) {
         greenSel_ = sel;
+        marksTimer_->start();
     }
     QList<QTextEdit::ExtraSelection> getRedSel() const {
         return redSel_;
     }
     void setRedSel (QList<QTextEdit::ExtraSelection> sel) {
         redSel_ = sel;
+        marksTimer_->start();
+    }
+    /* Hides QPlainTextEdit::setExtraSelections(). Line numbers don't depend on
+       extra selections; so, their area isn't repainted when only they change. */
+    void setExtraSelections (const QList<QTextEdit::ExtraSelection> &selections) {
+        changingSelections_ = true;
+        QPlainTextEdit::setExtraSelections (selections);
+        changingSelections_ = false;
     }
 
     bool isUneditable() const {
@@ -150,9 +167,41 @@ public:
     QSyntaxHighlighter *getHighlighter() const {
         return highlighter_;
     }
-    void setHighlighter (QSyntaxHighlighter *h) {
-        highlighter_ = h;
-    }
+    /* the bracket scanner is used only when there's no highlighter */
+    void setHighlighter (QSyntaxHighlighter *h);
+    BracketScanner *getBracketScanner() const {
+        return bracketScanner_;
+    }
+    /* the bracket index of the highlighter or scanner (null if not available) */
+    const BracketIndex *getBracketIndex() const;
+
+    /* A plain text copy of the document for searching, in which positions
+       are those of the document. It's made only when needed after changes.
+       Unlike QTextDocument::toPlainText(), it keeps non-breaking spaces. */
+    const QString &plainTextSnapshot();
+    /* Makes the snapshot block by block for about "msecs" milliseconds, so that
+       the GUI isn't blocked by a large document, and returns true when it's ready.
+       The work is continued by the next call unless the text changes. */
+    bool makeSnapshot (int msecs);
+    /* a part of the text, made like the snapshot */
+    QString plainTextRange (int from, int to) const;
+    /* changed whenever the text changes and unique among all documents */
+    int getTextRevision() const {
+        return textRevision_;
+    }
+    /* the positions of the matches of the searched text */
+    SearchIndex *getSearchIndex() const {
+        return searchIndex_;
+    }
+
+    /* Code folding: a block can be folded if it has an unclosed brace
+       or if the next non-empty block is more indented than it. */
+    bool isFoldable (const QTextBlock &block);
+    bool isFolded (const QTextBlock &block) const {
+        return folds_.contains (block.blockNumber());
+    }
+    bool toggleFold (const QTextBlock &block);
+    void unfoldAll();
 
     bool getInertialScrolling() const {
         return inertialScrolling_;
@@ -218,15 +267,50 @@ private slots:
     void onUpdateRequesting (const QRect&, int dy);
     void onSelectionChanged();
     void scrollWithInertia();
+    void onContentsChange (int pos, int charsRemoved, int charsAdded);
+    void unfoldAtCursor();
+    void updateScrollMarks();
 
 private:
     QString computeIndentation (const QTextCursor &cur) const;
+    int foldEnd (const QTextBlock &block);
+    int indentationFoldEnd (const QTextBlock &block);
+    int cachedFoldEnd (int blockNumber) const;
+    void updateFoldVisibility (int first, int last);
+    int blockIndentation (const QTextBlock &block);
+    void updateGuideMetrics();
+    void updateDigitPixmaps();
+    void stopInertialScrolling();
 
     int prevAnchor, prevPos; // used only for bracket matching
     QWidget *lineNumberArea;
+    QWidget *frameGraph_; // shown only when frame times are collected
+    int lineNumberAreaWidth_; // the current left margin of the viewport
+    QVector<QPixmap> digitPixmaps_; // the pre-rendered digits of line numbers
+    QVector<int> digitWidths_;
+    QFont digitFont_;
+    qreal digitRatio_;
+    bool changingSelections_; // the line numbers aren't updated when only extra selections change
+    QColor digitBackground_; // the background of digit pixmaps
     QTextEdit::ExtraSelection currentLine;
     bool autoIndentation;
     bool drawIndetLines;
+    BlockCache<int> indents_; // the indentation lengths of blocks (-1 if not known)
+    /* The indented regions after blocks, which are kept with their lengths, so
+       that they needn't be shifted when blocks are added or removed before them.
+       The regions that may be changed by an edit inside them are found lazily by
+       comparing their generations with those of the last edits (see onContentsChange). */
+    struct FoldEnd
+    {
+        int length; // the number of blocks in the region (0 if none, -1 if not known)
+        int generation; // the value of foldGeneration_ when the region was found
+    };
+    BlockCache<FoldEnd> foldEnds_;
+    QVector<QPair<int, int> > foldEdits_; // the last non-empty blocks before edits and their generations
+    int foldGeneration_; // increased with each edit
+    int foldBaseGeneration_; // older regions aren't valid
+    QFont guideFont_; // the font of the metrics of indentation lines
+    qreal guideTabWidth_, guideLineSpacing_, guideHeight_;
     bool autoBracket;
     bool scrollJumpWorkaround; // for working around Qt5's scroll jump bug
     bool darkScheme;
@@ -253,19 +337,27 @@ private:
     QList<QTextEdit::ExtraSelection> redSel_; // for bracket matches
     bool uneditable_; // the doc should be made uneditable because of its contents
     QSyntaxHighlighter *highlighter_; // syntax highlighter
+    BracketScanner *bracketScanner_; // for bracket matching without highlighter
+    /* The folded regions, whose start blocks are the keys and whose last hidden
+       blocks are the values. They're either nested or disjoint and, since they're
+       made by the user, they're few. They're shifted when blocks are added or
+       removed before them and are unfolded when their contents change. */
+    QMap<int, int> folds_;
+    int foldBlockCount_;
+    QString snapshot_;
+    SearchIndex *searchIndex_;
+    QTimer *marksTimer_; // for updating the marks of the scrollbar after changes
+    bool snapshotValid_;
+    int snapshotBlocks_; // the number of blocks in a snapshot that isn't complete yet
+    int textRevision_;
     bool saveCursor_;
     /******************************
      ***** Inertial scrolling *****
      ******************************/
     bool inertialScrolling_;
-    struct scollData {
-      int delta;
-      int leftSteps;
-      int totalSteps;
-    };
-    QTimer *scrollTimer_;
-    QWheelEvent *wheelEvent_;
-    QList<scollData> queuedScrollSteps_;
+    QTimer *scrollTimer_; // fires once per frame of the screen
+    QElapsedTimer scrollClock_; // the movement depends on the time, not on the number of frames
+    qreal scrollPos_, scrollTarget_; // in the units of the vertical scrollbar
 };
 /*************************/
 class LineNumberArea : public QWidget
@@ -283,6 +375,9 @@ protected:
     void paintEvent(QPaintEvent *event) {
         editor->lineNumberAreaPaintEvent (event);
     }
+    void mousePressEvent (QMouseEvent *event) {
+        editor->lineNumberAreaMousePressEvent (event);
+    }
 
 private:
     TextEdit *editor;
@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include "textsearch.h"
+
+#define CUT_MARGIN 1024 // in characters
+
+namespace FeatherPad {
+
+TextSearch::TextSearch (const QString &str, Qt::CaseSensitivity cs, bool wholeWords, bool regex)
+{
+    pattern_ = str;
+    cs_ = cs;
+    wholeWords_ = wholeWords;
+    isRegex_ = regex;
+    textRevision_ = checkedRevision_ = -1;
+    validText_ = false;
+    if (isRegex_)
+    {
+        regex_.setPattern (str);
+        regex_.setPatternOptions (cs == Qt::CaseSensitive
+                                  ? QRegularExpression::MultilineOption
+                                  : QRegularExpression::MultilineOption | QRegularExpression::CaseInsensitiveOption);
+        regex_.optimize();
+    }
+    else
+    {
+        needle_ = str;
+        if (cs == Qt::CaseInsensitive)
+        {
+            const int l = str.length();
+            for (int i = 0; i < l; ++i)
+                needle_[i] = charAt (str.constData(), l, i);
+        }
+    }
+
+    const int l = needle_.length();
+    for (int i = 0; i < 256; ++i)
+        skip_[i] = backSkip_[i] = qMax (l, 1);
+    /* characters with the same lower byte share the smallest shift */
+    for (int i = 0; i < l - 1; ++i)
+        skip_[needle_.at (i).unicode() & 0xff] = l - 1 - i;
+    for (int i = l - 1; i > 0; --i)
+        backSkip_[needle_.at (i).unicode() & 0xff] = i;
+}
+/*************************/
+bool TextSearch::isValid() const
+{
+    if (isRegex_)
+        return regex_.isValid() && !regex_.pattern().isEmpty();
+    return !needle_.isEmpty();
+}
+/*************************/
+// Folds the code point of a surrogate pair and returns the half that is at "i".
+// A lone surrogate is returned unchanged.
+QChar TextSearch::foldedSurrogate (const QChar *chars, int length, int i)
+{
+    const QChar c = chars[i];
+    if (c.isHighSurrogate())
+    {
+        if (i + 1 < length && chars[i + 1].isLowSurrogate())
+        {
+            const uint folded = QChar::toCaseFolded (QChar::surrogateToUcs4 (c, chars[i + 1]));
+            if (QChar::requiresSurrogates (folded))
+                return QChar (QChar::highSurrogate (folded));
+        }
+    }
+    else if (i > 0 && chars[i - 1].isHighSurrogate())
+    {
+        const uint folded = QChar::toCaseFolded (QChar::surrogateToUcs4 (chars[i - 1], c));
+        if (QChar::requiresSurrogates (folded))
+            return QChar (QChar::lowSurrogate (folded));
+    }
+    return c;
+}
+/*************************/
+// The same as in QTextDocument.
+bool TextSearch::isWholeWord (const QString &text, int pos, int length) const
+{
+    const int end = pos + length;
+    return !((pos != 0 && text.at (pos - 1).isLetterOrNumber())
+             || (end != text.length() && text.at (end).isLetterOrNumber()));
+}
+/*************************/
+int TextSearch::indexIn (const QString &text, int from, int lastStart, int *length) const
+{
+    if (isRegex_)
+        return regexIndexIn (text, from, lastStart, length);
+
+    const int l = needle_.length();
+    if (l == 0) return -1;
+    const int maxStart = text.length() - l;
+    if (lastStart < 0 || lastStart > maxStart)
+        lastStart = maxStart;
+
+    const QChar *chars = text.constData();
+    const int textLength = text.length();
+    const QChar *needle = needle_.constData();
+    const QChar lastChar = needle[l - 1];
+    int i = qMax (from, 0);
+    while (i <= lastStart)
+    {
+        const QChar c = charAt (chars, textLength, i + l - 1);
+        if (c == lastChar)
+        {
+            int j = l - 2;
+            while (j >= 0 && charAt (chars, textLength, i + j) == needle[j])
+                --j;
+            if (j < 0 && (!wholeWords_ || isWholeWord (text, i, l)))
+            {
+                if (length)
+                    *length = l;
+                return i;
+            }
+        }
+        i += skip_[c.unicode() & 0xff];
+    }
+    return -1;
+}
+/*************************/
+int TextSearch::lastIndexIn (const QString &text, int from, int *length) const
+{
+    if (isRegex_)
+    {
+        /* search forward in larger and larger ranges before "from", without
+           going past its line (otherwise, the last search in each range
+           could go to the end of the text) */
+        int end = qMin (from, text.length());
+        int subjectEnd = text.indexOf ('\n', qMax (end, 0));
+        subjectEnd = subjectEnd < 0 ? text.length() : subjectEnd + 1;
+        int range = 1024;
+        while (end >= 0)
+        {
+            const int start = qMax (end - range, 0);
+            int res = -1, l = 0, i = start, pos;
+            while ((pos = regexIndexIn (text, i, end, &l, subjectEnd)) >= 0)
+            {
+                res = pos;
+                if (length)
+                    *length = l;
+                i = pos + 1;
+            }
+            if (res >= 0) return res;
+            end = start - 1;
+            range *= 2;
+        }
+        return -1;
+    }
+
+    const int l = needle_.length();
+    if (l == 0) return -1;
+    int i = qMin (from, text.length() - l);
+
+    const QChar *chars = text.constData();
+    const int textLength = text.length();
+    const QChar *needle = needle_.constData();
+    const QChar firstChar = needle[0];
+    while (i >= 0)
+    {
+        const QChar c = charAt (chars, textLength, i);
+        if (c == firstChar)
+        {
+            int j = 1;
+            while (j < l && charAt (chars, textLength, i + j) == needle[j])
+                ++j;
+            if (j == l && (!wholeWords_ || isWholeWord (text, i, l)))
+            {
+                if (length)
+                    *length = l;
+                return i;
+            }
+        }
+        i -= backSkip_[c.unicode() & 0xff];
+    }
+    return -1;
+}
+
+/*************************/
+// Lone surrogates make a text invalid.
+static bool isValidUtf16 (const QString &text)
+{
+    const int l = text.length();
+    const QChar *chars = text.constData();
+    for (int i = 0; i < l; ++i)
+    {
+        if (chars[i].isHighSurrogate())
+        {
+            if (i + 1 < l && chars[i + 1].isLowSurrogate())
+                ++i;
+            else
+                return false;
+        }
+        else if (chars[i].isLowSurrogate())
+            return false;
+    }
+    return true;
+}
+/*************************/
+// See setTextRevision().
+QRegularExpression::MatchOptions TextSearch::matchOptions (const QString &text) const
+{
+    bool valid;
+    if (textRevision_ < 0)
+        valid = isValidUtf16 (text);
+    else
+    {
+        if (checkedRevision_ != textRevision_)
+        {
+            checkedRevision_ = textRevision_;
+            validText_ = isValidUtf16 (text);
+        }
+        valid = validText_;
+    }
+    return valid ? QRegularExpression::DontCheckSubjectStringMatchOption
+                 : QRegularExpression::NoMatchOption;
+}
+/*************************/
+// If "subjectEnd" isn't negative, matches can't go past it. It shouldn't be
+// between the halves of a surrogate pair.
+int TextSearch::regexIndexIn (const QString &text, int from, int lastStart, int *length,
+                              int subjectEnd) const
+{
+    if (!isValid()) return -1;
+    if (subjectEnd < 0 || subjectEnd > text.length())
+        subjectEnd = text.length();
+    if (lastStart < 0 || lastStart > subjectEnd)
+        lastStart = subjectEnd;
+
+    /* The subject is cut a little after "lastStart", so that a bounded search
+       doesn't scan the rest of the text. A hard partial match shows that the
+       cut may change the result, in which case the search is done without it. */
+    int cut = qMin (lastStart + CUT_MARGIN, subjectEnd);
+    if (cut > 0 && cut < subjectEnd && text.at (cut - 1).isHighSurrogate())
+        ++cut;
+
+    const QRegularExpression::MatchOptions options = matchOptions (text);
+    int i = qMax (from, 0);
+    while (i <= lastStart)
+    {
+#if QT_VERSION >= 0x050500
+        QRegularExpressionMatch match;
+        if (cut < subjectEnd)
+        {
+            match = regex_.match (text.leftRef (cut), i, QRegularExpression::PartialPreferFirstMatch, options);
+            if (match.hasPartialMatch() && match.capturedStart() > lastStart)
+                return -1;
+        }
+        if (cut == subjectEnd || match.hasPartialMatch())
+        {
+            match = subjectEnd < text.length()
+                    ? regex_.match (text.leftRef (subjectEnd), i, QRegularExpression::NormalMatch, options)
+                    : regex_.match (text, i, QRegularExpression::NormalMatch, options);
+        }
+#else
+        const QRegularExpressionMatch match = regex_.match (text, i, QRegularExpression::NormalMatch, options);
+#endif
+        if (!match.hasMatch()) return -1;
+        const int pos = match.capturedStart();
+        if (pos > lastStart) return -1;
+        const int l = match.capturedLength();
+        if (l > 0 && (!wholeWords_ || isWholeWord (text, pos, l)))
+        {
+            if (length)
+                *length = l;
+            return pos;
+        }
+        i = pos + 1; // empty matches are of no use
+    }
+    return -1;
+}
+/*************************/
+QString TextSearch::replacement (const QString &text, int pos, const QString &replaceWith) const
+{
+    if (!isRegex_) return replaceWith;
+
+    const QRegularExpressionMatch match = regex_.match (text, pos, QRegularExpression::NormalMatch,
+                                                        matchOptions (text) | QRegularExpression::AnchoredMatchOption);
+    if (!match.hasMatch()) return replaceWith;
+
+    QString res;
+    const int l = replaceWith.length();
+    res.reserve (l);
+    for (int i = 0; i < l; ++i)
+    {
+        const QChar c = replaceWith.at (i);
+        if ((c == '\\' || c == '$') && i + 1 < l)
+        {
+            const QChar next = replaceWith.at (i + 1);
+            if (next.isDigit())
+            {
+                res += match.captured (next.digitValue());
+                ++i;
+                continue;
+            }
+            if (c == '\\')
+            {
+                if (next == 'n')
+                    res += '\n';
+                else if (next == 't')
+                    res += '\t';
+                else // an escaped character
+                    res += next;
+                ++i;
+                continue;
+            }
+            if (next == '$')
+            {
+                res += next;
+                ++i;
+                continue;
+            }
+        }
+        res += c;
+    }
+    return res;
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <QString>
+#include <QRegularExpression>
+
+namespace FeatherPad {
+
+/* A literal search with the Boyer-Moore-Horspool algorithm, which is used
+   on a plain text copy of the document (where line ends are '\n' and the
+   positions are those of the document). Matches may contain line ends.
+   In the regex mode, the pattern is compiled once, with JIT if possible,
+   and empty matches are skipped. */
+class TextSearch
+{
+public:
+    TextSearch (const QString &str, Qt::CaseSensitivity cs, bool wholeWords, bool regex = false);
+
+    bool isRegex() const {
+        return isRegex_;
+    }
+    /* whether this object is made with these arguments */
+    bool isSearchFor (const QString &str, Qt::CaseSensitivity cs, bool wholeWords, bool regex) const {
+        return str == pattern_ && cs == cs_ && wholeWords == wholeWords_ && regex == isRegex_;
+    }
+    /* false with an empty string or an invalid regex */
+    bool isValid() const;
+    /* the length of literal matches */
+    int length() const {
+        return needle_.length();
+    }
+
+    /* Returns the first match starting at or after "from" and not after
+       "lastStart" (-1 means the end of the text), or -1 if there's none.
+       The length of the match is put into "length" if it isn't null.
+       Not much of the text after "lastStart" is scanned. */
+    int indexIn (const QString &text, int from, int lastStart = -1, int *length = nullptr) const;
+    /* Returns the last match starting at or before "from", or -1.
+       A regex match can't go past the line of "from" (with Qt >= 5.5). */
+    int lastIndexIn (const QString &text, int from, int *length = nullptr) const;
+
+    /* Tells that the following texts are the same until the revision changes
+       (-1, the default, means an unknown text). PCRE checks the UTF-16 validity
+       of the whole text on each match unless it's told not to; so, the check is
+       done here once for each revision and on each call without a revision. */
+    void setTextRevision (int revision) {
+        textRevision_ = revision;
+    }
+
+    /* The replacement of the match at "pos". In the regex mode, "\1", "$1",...
+       are replaced by captured texts and "\n" and "\t" by control characters. */
+    QString replacement (const QString &text, int pos, const QString &replaceWith) const;
+
+private:
+    /* If the search is case insensitive, a UTF-16 unit is case folded as a part
+       of its code point, so that the needle and text are folded in the same way. */
+    QChar charAt (const QChar *chars, int length, int i) const {
+        if (cs_ == Qt::CaseSensitive) return chars[i];
+        const QChar c = chars[i];
+        return c.isSurrogate() ? foldedSurrogate (chars, length, i) : c.toCaseFolded();
+    }
+    static QChar foldedSurrogate (const QChar *chars, int length, int i);
+    bool isWholeWord (const QString &text, int pos, int length) const;
+    int regexIndexIn (const QString &text, int from, int lastStart, int *length,
+                      int subjectEnd = -1) const;
+    QRegularExpression::MatchOptions matchOptions (const QString &text) const;
+
+    QString pattern_;
+    QString needle_; // case folded by charAt() if the search is case insensitive
+    Qt::CaseSensitivity cs_;
+    bool wholeWords_;
+    bool isRegex_;
+    QRegularExpression regex_;
+    int textRevision_;
+    /* the last checked revision and whether its text is valid UTF-16 */
+    mutable int checkedRevision_;
+    mutable bool validText_;
+    /* shift tables of the forward and backward searches,
+       indexed by the lower bytes of characters */
+    int skip_[256];
+    int backSkip_[256];
+};
+
+}
+
+#endif // TEXTSEARCH_H
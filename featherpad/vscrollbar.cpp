@@ -20,6 +20,10 @@
 #include "vscrollbar.h"
 #include <QEvent>
 #include <QApplication>
+#include <QPainter>
+#include <QStyleOptionSlider>
+
+#define MARK_WIDTH 4 // in pixels
 
 namespace FeatherPad {
 
@@ -45,5 +49,66 @@ bool VScrollBar::event (QEvent *event)
 
     return QScrollBar::event (event);
 }
+/*************************/
+QRect VScrollBar::grooveRect() const
+{
+    QStyleOptionSlider opt;
+    initStyleOption (&opt);
+    return style()->subControlRect (QStyle::CC_ScrollBar, &opt, QStyle::SC_ScrollBarGroove, this);
+}
+/*************************/
+int VScrollBar::grooveLength() const
+{
+    return qMax (grooveRect().height(), 0);
+}
+/*************************/
+void VScrollBar::setMarks (const QVector<uchar> &marks)
+{
+    if (marks == marks_) return;
+    marks_ = marks;
+    update();
+}
+/*************************/
+void VScrollBar::resizeEvent (QResizeEvent *event)
+{
+    QScrollBar::resizeEvent (event);
+    emit grooveChanged();
+}
+/*************************/
+// Neighboring pixels with the same mark are painted together.
+void VScrollBar::paintEvent (QPaintEvent *event)
+{
+    QScrollBar::paintEvent (event);
+    if (marks_.isEmpty()) return;
+    const QRect groove = grooveRect();
+    if (marks_.size() != groove.height()) return; // the marks will be set again
+
+    QPainter painter (this);
+    const int x = groove.right() - MARK_WIDTH + 1;
+    const int count = marks_.size();
+    int y = 0;
+    while (y < count)
+    {
+        const uchar m = marks_.at (y);
+        if (m == 0)
+        {
+            ++y;
+            continue;
+        }
+        int end = y + 1;
+        while (end < count && marks_.at (end) == m)
+            ++end;
+        QColor color;
+        if (m & BracketMark)
+            color = QColor (220, 0, 0);
+        else if (m & ReplaceMark)
+            color = QColor (0, 170, 0);
+        else
+            color = QColor (210, 170, 0);
+        /* a single mark is made 2 pixels high to be visible */
+        painter.fillRect (x, groove.top() + y, MARK_WIDTH, qMax (end - y, 2), color);
+        y = end;
+    }
+}
 
 }
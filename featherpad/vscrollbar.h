@@ -21,22 +21,44 @@
 #define VSCROLLBAR_H
 
 #include <QScrollBar>
+#include <QVector>
 
 namespace FeatherPad {
 
 /* We want faster mouse wheel scrolling
-   when the mouse cursor is on the scrollbar. */
+   when the mouse cursor is on the scrollbar.
+   The scrollbar also shows marks for search matches, replacements and
+   bracket matches. They're given as one byte of mark flags per pixel of
+   the groove, so that painting doesn't depend on the number of marks. */
 class VScrollBar : public QScrollBar
 {
     Q_OBJECT
 public:
     VScrollBar (QWidget *parent = 0);
 
+    enum Mark {
+        SearchMark = 1,
+        ReplaceMark = 2,
+        BracketMark = 4
+    };
+
+    /* the length of the groove in pixels, which is the size of marks */
+    int grooveLength() const;
+    void setMarks (const QVector<uchar> &marks);
+
+signals:
+    void grooveChanged(); // marks should be set again
+
 protected:
     bool event (QEvent *event);
+    void paintEvent (QPaintEvent *event);
+    void resizeEvent (QResizeEvent *event);
 
 private:
+    QRect grooveRect() const;
+
     int defaultWheelSpeed;
+    QVector<uchar> marks_;
 };
 
 }
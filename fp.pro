@@ -1,5 +1,9 @@
 SUBDIRS += featherpad
 
+# "qmake CONFIG+=tests" also builds the benchmarks and tests
+tests: SUBDIRS += tests/highlighter \
+                  tests/search
+
 TEMPLATE = subdirs 
 
 CONFIG += qt \
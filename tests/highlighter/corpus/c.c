@@ -0,0 +1,32 @@
+/* A C corpus for the highlighter tests.
+ * It has multi-line comments, strings with escapes and preprocessor lines.
+ */
+#include <stdio.h>
+#include "local.h"
+#define MAX(a, b) ((a) > (b) ? (a) : (b)) /* a macro */
+#define STR "a \"quoted\" string with /* no comment */"
+
+typedef struct {
+    int x, y; // coordinates
+    const char *name;
+} point_t;
+
+static const char *names[] = {"one", "two \"2\"", "th\\ree", 'q' == 'q' ? "yes" : "no"};
+
+int main (int argc, char **argv)
+{
+    char c = '\'';
+    char d = '"';
+    unsigned long n = 0x1fUL + 017 + 42u + 3.14e-2f;
+    /* a comment with "quotes" and 'apostrophes' */
+    printf ("%d %s\n", argc, argv[0]); // "not a string"
+    if (n > 10 && c != d) {
+        for (int i = 0; i < 10; ++i)
+            n += i * MAX (i, 3);
+    }
+    const char *s = "line one \
+line two";
+    return 0; /* unfinished comment
+    continues here
+    and ends */ }
+const char *long_line = "a" "b" "c" "d\"" "e" "f" "g" "h" "i\\" "j" "k" "l" "m" "n" "o" "p" "q" "r" "s" "t" "u" "v" "w" "x" "y" "z" "0" "1" "2" "3" "4" "5" "6" "7" "8" "9";
@@ -0,0 +1,13 @@
+# A CMake corpus for the highlighter tests.
+cmake_minimum_required(VERSION 3.1)
+project(Example LANGUAGES CXX)
+
+set(SOURCES main.cpp "with space.cpp")
+option(WITH_TESTS "Build the tests" ON)
+
+if(WITH_TESTS AND NOT WIN32)
+  message(STATUS "Tests: ${WITH_TESTS} in ${CMAKE_BINARY_DIR}")
+endif()
+
+add_executable(example ${SOURCES})
+target_link_libraries(example PRIVATE Qt5::Widgets) # a comment
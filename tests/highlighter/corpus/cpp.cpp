@@ -0,0 +1,44 @@
+// A C++ corpus for the highlighter tests.
+#include <QString>
+#include <vector>
+
+namespace Test {
+
+template <typename T>
+class Box : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Box (T value) : value_ (value) {}
+    virtual ~Box() = default;
+
+    T value() const { return value_; }
+    static constexpr int size = sizeof (T);
+
+signals:
+    void changed();
+
+private:
+    T value_; /* a member */
+};
+
+auto raw = R"(a raw string with "quotes" and \ backslashes)";
+auto raw2 = R"delim(another ) raw " string)delim";
+std::vector<std::string> v {"a", "b\n", "c\"d"};
+
+int f (int x)
+{
+    switch (x) {
+    case 1: return 'a';
+    case 2: return L'b';
+    default: break;
+    }
+    /* nested /* isn't nested */
+    int y = x > 0 ? x : -x; // "comment"
+    return y << 2 | 0b1010 & ~0xFF;
+}
+
+} // namespace Test
+/*
+ * a trailing comment
+ */
@@ -0,0 +1,29 @@
+// A JavaScript corpus for the highlighter tests.
+'use strict';
+
+const re = /ab+c\/[a-z]*/gi;
+const notRe = a / b / c;
+let s = "double \"quoted\"", t = 'single', u = `template ${s + t} string`;
+
+/* a block
+   comment */
+function add (a, b = 2) {
+    return a + b; // a comment
+}
+
+class Point {
+    constructor (x, y) {
+        this.x = x;
+        this.y = y;
+    }
+    get length () {
+        return Math.sqrt (this.x ** 2 + this.y ** 2);
+    }
+}
+
+if (re.test ("abbc") && s.length > 0) {
+    console.log (add (1), new Point (3, 4).length, null, undefined, true);
+}
+const arr = [1, 2, 3].map (x => x / 2).filter (x => /\d/.test (String (x)));
+const multi = `a template
+over ${lines} lines`;
@@ -0,0 +1,23 @@
+-- A Lua corpus for the highlighter tests.
+local M = {}
+
+--[[ a block
+comment with "quotes" ]]
+
+function M.greet(name)
+  local s = "Hello, " .. name .. "!"
+  local t = 'single \'quoted\''
+  local long = [[a long
+string with "quotes"]]
+  return s, t, long
+end
+
+for i = 1, 10 do
+  if i % 2 == 0 then
+    print(i, nil, true, false)
+  elseif i == 3 then
+    print("three") -- comment
+  end
+end
+
+return M
@@ -0,0 +1,18 @@
+# A Makefile corpus for the highlighter tests.
+CC ?= gcc
+CFLAGS := -O2 -Wall "-DNAME=\"x\""
+OBJS = $(patsubst %.c,%.o,$(wildcard *.c))
+
+.PHONY: all clean
+
+all: app
+
+app: $(OBJS)
+	$(CC) $(CFLAGS) -o $@ $^ # link
+
+%.o: %.c
+	$(CC) $(CFLAGS) -c $< -o $@
+
+clean:
+	rm -f app *.o
+	@echo "cleaned ${CURDIR}"
@@ -0,0 +1,39 @@
+#!/usr/bin/perl
+# A Perl corpus for the highlighter tests.
+use strict;
+use warnings;
+
+my $name = "world";
+my @list = (1, 2, 3);
+my %hash = (key => 'value', "other" => "v2");
+
+print "Hello, $name!\n";
+print 'single $name', "\n";
+
+print <<EOT;
+A here-doc with $name
+and "quotes"
+EOT
+
+print <<'RAW';
+no $interpolation here
+RAW
+
+if ($name =~ m/w(or)ld/i) {
+    $name =~ s/world/there/g;
+}
+my $re = qr{a+b*};
+my @words = qw(one two three);
+
+sub greet {
+    my ($who) = @_;
+    return "Hi, $who";  # comment
+}
+
+=pod
+
+POD documentation "with quotes"
+
+=cut
+
+print greet ($name), "\n";
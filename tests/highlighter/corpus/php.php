@@ -0,0 +1,20 @@
+<!DOCTYPE html>
+<html>
+<body>
+<?php
+// A PHP corpus for the highlighter tests.
+$name = "world";
+echo "Hello, $name!";
+echo 'single $name';
+/* a block
+   comment */
+function greet($who = 'you') {
+    return "Hi, {$who}"; # comment
+}
+$text = <<<EOT
+A heredoc with $name
+EOT;
+?>
+<p class="x">After <?= greet($name) ?></p>
+</body>
+</html>
@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+# A Python corpus for the highlighter tests.
+"""A module docstring
+that spans several lines with 'quotes' and "double quotes".
+"""
+
+import os
+from collections import defaultdict
+
+
+class Counter(object):
+    '''A class docstring.'''
+
+    def __init__(self, name="counter", *args, **kwargs):
+        self.name = name  # a comment
+        self.counts = defaultdict(int)
+
+    @property
+    def total(self):
+        return sum(self.counts.values())
+
+    def add(self, key):
+        self.counts[key] += 1
+        return f"{key}: {self.counts[key]!r}"
+
+
+def main():
+    c = Counter()
+    for word in "a b a c".split():
+        c.add(word)
+    s = r"raw \d+ string" + b'bytes' + u"unicode"
+    text = """triple "quoted" string
+    with # no comment
+    """
+    print(c.total, s, text, 0x1F, 1e-3, None, True, False)
+    lambda x: x ** 2
+
+
+if __name__ == "__main__":
+    main()
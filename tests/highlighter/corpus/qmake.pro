@@ -0,0 +1,14 @@
+# A qmake corpus for the highlighter tests.
+QT += core gui widgets
+TARGET = example
+TEMPLATE = app
+CONFIG += c++11
+
+SOURCES += main.cpp \
+           window.cpp
+
+unix:!macx {
+  LIBS += -lX11
+  DEFINES += DATADIR=\\\"$$PREFIX/share\\\"
+}
+message("Building $${TARGET}")
@@ -0,0 +1,19 @@
+// A QML corpus for the highlighter tests.
+import QtQuick 2.0
+
+Rectangle {
+    id: root
+    width: 200; height: 100
+    color: "lightsteelblue"
+    property string label: "a \"label\""
+
+    Text {
+        anchors.centerIn: parent
+        text: root.label + ' ' + Qt.formatDate(new Date())
+    }
+    /* a comment */
+    MouseArea {
+        anchors.fill: parent
+        onClicked: { console.log("clicked"); root.color = "red" }
+    }
+}
@@ -0,0 +1,33 @@
+# A Ruby corpus for the highlighter tests.
+require 'set'
+
+module Shapes
+  class Circle
+    attr_reader :radius
+
+    def initialize(radius = 1.0)
+      @radius = radius
+    end
+
+    def area
+      Math::PI * @radius ** 2 # a comment
+    end
+
+    def to_s
+      "Circle(#{@radius}) with 'quotes'"
+    end
+  end
+end
+
+=begin
+a block comment
+with "quotes"
+=end
+
+c = Shapes::Circle.new(2)
+puts c.to_s, :symbol, %w(a b c)
+[1, 2, 3].each { |x| puts x * 2 }
+text = <<~HEREDOC
+  A squiggly here-doc #{c.area}
+HEREDOC
+puts text if c.radius > 1
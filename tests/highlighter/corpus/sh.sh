@@ -0,0 +1,40 @@
+#!/bin/bash
+# A shell corpus with here-docs, command substitutions and quotes.
+
+NAME="world"
+echo "Hello, $NAME! It's $(date +%Y) and ${HOME:-/root}"
+echo 'single $NAME "quoted"'
+VAR=`echo backticks "inside"`
+
+cat <<EOF
+a here-doc with $NAME and "quotes"
+  and 'apostrophes' and # no comment
+EOF
+
+cat <<-'RAW'
+	a quoted here-doc, no $expansion
+	RAW
+
+cat << "X" | grep a
+x "one
+X
+
+f() {
+    local a=$(echo "$(echo "nested $(echo "deep")")")
+    if [[ -n "$a" && $# -gt 0 ]]; then
+        for i in "$@"; do
+            case "$i" in
+                -h|--help) echo "help" ;;
+                *) echo "$i" ;;
+            esac
+        done
+    fi
+    return 0
+}
+
+arr=( "a b" 'c d' e )
+echo ${arr[@]} $((1 + 2 * 3)) # arithmetic
+echo "a" "b" "c" "d" "e" "f" "g" "h" "i" "j" "k" "l" "m" "n" "o" "p" "q" "r" "s" "t" "u" "v" "w" "x" "y" "z"
+echo "unterminated quote
+continues here
+and ends"
@@ -0,0 +1,28 @@
+# A headless benchmark and golden-output test of the syntax highlighter.
+# Build and run it with:
+#   qmake && make && ./highlighterbench [--update] [--repeat N] [language...]
+# The golden files are written into golden/ with --update. A missing one is a failure.
+
+QT += core gui \
+      widgets
+
+TARGET = highlighterbench
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+FP_SRC = ../../featherpad
+INCLUDEPATH += $$FP_SRC
+
+SOURCES += main.cpp \
+           $$FP_SRC/highlighter.cpp \
+           $$FP_SRC/highlighter-sh.cpp \
+           $$FP_SRC/highlighter-html.cpp \
+           $$FP_SRC/highlighter-patterns.cpp \
+           $$FP_SRC/highlighter-jsregex.cpp \
+           $$FP_SRC/bracketindex.cpp
+
+HEADERS += $$FP_SRC/highlighter.h \
+           $$FP_SRC/bracketindex.h
+
+DEFINES += CORPUS_DIR=\\\"$$PWD/corpus\\\" GOLDEN_DIR=\\\"$$PWD/golden\\\"
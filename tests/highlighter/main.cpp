@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+#include <QApplication>
+#include <QPlainTextDocumentLayout>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include "highlighter.h"
+
+#define VIEW_LINES 60 // the lines of a simulated viewport
+#define DEFAULT_REPEAT 50 // how many times a corpus is repeated for timing
+
+using namespace FeatherPad;
+
+/* the languages of FPwin::setProgLang() */
+static const char *languages[] = {
+    "c", "changelog", "cmake", "config", "cpp", "css", "deb", "desktop",
+    "diff", "gtkrc", "html", "javascript", "log", "lua", "m3u", "makefile",
+    "markdown", "perl", "php", "python", "qmake", "qml", "ruby", "sh",
+    "sourceslist", "srt", "theme", "troff", "url", "xml"
+};
+
+/* Times the blocks that are really highlighted. Deferred blocks, which
+   return early, aren't counted because they would skew the average. */
+class TimedHighlighter : public Highlighter
+{
+public:
+    TimedHighlighter (QTextDocument *doc, const QString &lang,
+                      const QTextCursor &start, const QTextCursor &end)
+        : Highlighter (doc, lang, start, end, false) {
+        resetTiming();
+    }
+
+    void resetTiming() {
+        totalNsecs = worstNsecs = 0;
+        blocks = 0;
+        worstBlock = -1;
+    }
+
+    qint64 totalNsecs, worstNsecs;
+    int blocks, worstBlock;
+
+protected:
+    void highlightBlock (const QString &text) {
+        QElapsedTimer timer;
+        timer.start();
+        Highlighter::highlightBlock (text);
+        qint64 nsecs = timer.nsecsElapsed();
+        TextBlockData *data = static_cast<TextBlockData *>(currentBlockUserData());
+        if (!data || data->isDeferred()) return;
+        totalNsecs += nsecs;
+        ++blocks;
+        if (nsecs > worstNsecs)
+        {
+            worstNsecs = nsecs;
+            worstBlock = currentBlock().blockNumber();
+        }
+    }
+};
+/*************************/
+static QTextDocument *makeDocument (const QString &text)
+{
+    QTextDocument *doc = new QTextDocument;
+    doc->setDocumentLayout (new QPlainTextDocumentLayout (doc));
+    doc->setPlainText (text);
+    return doc;
+}
+/*************************/
+static TimedHighlighter *makeHighlighter (QTextDocument *doc, const QString &lang,
+                                          int firstVisible, int lastVisible)
+{
+    QTextCursor start (doc->findBlockByNumber (firstVisible));
+    QTextCursor end (doc->findBlockByNumber (qMin (lastVisible, doc->blockCount() - 1)));
+    end.movePosition (QTextCursor::EndOfBlock);
+    return new TimedHighlighter (doc, lang, start, end);
+}
+/*************************/
+// Does what FPwin::formatTextRect() does when the given blocks are visible.
+static void showBlocks (Highlighter *highlighter, QTextDocument *doc, int first, int last)
+{
+    last = qMin (last, doc->blockCount() - 1);
+    QTextCursor start (doc->findBlockByNumber (first));
+    QTextCursor end (doc->findBlockByNumber (last));
+    end.movePosition (QTextCursor::EndOfBlock);
+    highlighter->setLimit (start, end);
+    highlighter->highlightDeferred (last);
+    QTextBlock block = start.block();
+    while (block.isValid() && block.blockNumber() <= last)
+    {
+        if (TextBlockData *data = static_cast<TextBlockData *>(block.userData()))
+        {
+            if (!data->isHighlighted())
+                highlighter->rehighlightBlock (block);
+        }
+        block = block.next();
+    }
+}
+/*************************/
+// One line per block, with the block state and the format ranges.
+static QStringList formatDump (QTextDocument *doc)
+{
+    QStringList dump;
+    for (QTextBlock block = doc->firstBlock(); block.isValid(); block = block.next())
+    {
+        QString line;
+        QTextStream stream (&line);
+        stream << block.blockNumber() + 1 << " [" << block.userState() << "]";
+#if QT_VERSION >= 0x050600
+        const QVector<QTextLayout::FormatRange> formats = block.layout()->formats();
+#else
+        const QList<QTextLayout::FormatRange> formats = block.layout()->additionalFormats();
+#endif
+        for (const QTextLayout::FormatRange &r : formats)
+        {
+            stream << ' ' << r.start << '+' << r.length << ':'
+                   << r.format.foreground().color().name();
+            if (r.format.fontWeight() > QFont::Normal)
+                stream << 'b';
+            if (r.format.fontItalic())
+                stream << 'i';
+            if (r.format.fontUnderline())
+                stream << 'u';
+        }
+        stream.flush();
+        dump << line;
+    }
+    return dump;
+}
+/*************************/
+static QVector<int> blockStates (QTextDocument *doc)
+{
+    QVector<int> states;
+    for (QTextBlock block = doc->firstBlock(); block.isValid(); block = block.next())
+        states.append (block.userState());
+    return states;
+}
+/*************************/
+// Compares the formats of the corpus with its golden file or, with "--update",
+// writes the file. Returns false on a mismatch or if the file doesn't exist.
+static bool checkGolden (const QString &lang, const QString &text, bool update, QTextStream &out)
+{
+    QTextDocument *doc = makeDocument (text);
+    TimedHighlighter *highlighter = makeHighlighter (doc, lang, 0, doc->blockCount() - 1);
+    QCoreApplication::processEvents(); // the delayed highlighting of the whole document
+    const QStringList dump = formatDump (doc);
+    delete highlighter;
+    delete doc;
+
+    QFile file (QString (GOLDEN_DIR) + "/" + lang + ".txt");
+    if (update)
+    {
+        QDir().mkpath (GOLDEN_DIR);
+        if (!file.open (QIODevice::WriteOnly | QIODevice::Text))
+        {
+            out << "  golden: cannot write " << file.fileName() << '\n';
+            return false;
+        }
+        QTextStream stream (&file);
+        for (const QString &line : dump)
+            stream << line << '\n';
+        out << "  golden: updated\n";
+        return true;
+    }
+    if (!file.exists())
+    {
+        out << "  golden: MISSING " << file.fileName() << " (use --update to write it)\n";
+        return false;
+    }
+    if (!file.open (QIODevice::ReadOnly | QIODevice::Text))
+    {
+        out << "  golden: cannot read " << file.fileName() << '\n';
+        return false;
+    }
+    QStringList golden = QString::fromUtf8 (file.readAll()).split ('\n');
+    if (!golden.isEmpty() && golden.last().isEmpty())
+        golden.removeLast();
+    for (int i = 0; i < qMax (golden.size(), dump.size()); ++i)
+    {
+        const QString expected = i < golden.size() ? golden.at (i) : QString();
+        const QString actual = i < dump.size() ? dump.at (i) : QString();
+        if (expected != actual)
+        {
+            out << "  golden: MISMATCH at line " << i + 1 << '\n'
+                << "    expected: " << expected << '\n'
+                << "    actual:   " << actual << '\n';
+            return false;
+        }
+    }
+    out << "  golden: ok\n";
+    return true;
+}
+/*************************/
+// Times highlighting the repeated corpus as a whole, page by page and with edits.
+// The block states after the edits should be the same as before them.
+// Returns false if they aren't.
+static bool benchmark (const QString &lang, const QString &text, int repeat, QTextStream &out)
+{
+    const int corpusLines = text.count ('\n') + 1;
+    QString big = text;
+    for (int i = 1; i < repeat; ++i)
+        big += "\n" + text;
+
+    /* the whole document */
+    QTextDocument *doc = makeDocument (big);
+    const int lines = doc->blockCount();
+    TimedHighlighter *highlighter = makeHighlighter (doc, lang, 0, lines - 1);
+    QElapsedTimer timer;
+    timer.start();
+    QCoreApplication::processEvents();
+    const qint64 wholeNsecs = timer.nsecsElapsed();
+    const QVector<int> states = blockStates (doc);
+    out << "  whole text: " << lines << " lines, "
+        << wholeNsecs / qMax (lines, 1) << " ns/line\n";
+    if (highlighter->blocks > 0)
+    {
+        out << "  blocks: " << highlighter->totalNsecs / highlighter->blocks << " ns/block, "
+            << "worst: corpus line " << highlighter->worstBlock % corpusLines + 1
+            << " (" << highlighter->worstNsecs << " ns)\n";
+    }
+    delete highlighter;
+    delete doc;
+
+    /* scrolling page by page */
+    doc = makeDocument (big);
+    highlighter = makeHighlighter (doc, lang, 0, VIEW_LINES - 1);
+    QCoreApplication::processEvents();
+    qint64 totalPage = 0, worstPage = 0;
+    int pages = 0;
+    for (int first = 0; first < lines; first += VIEW_LINES)
+    {
+        timer.restart();
+        showBlocks (highlighter, doc, first, first + VIEW_LINES - 1);
+        const qint64 nsecs = timer.nsecsElapsed();
+        totalPage += nsecs;
+        worstPage = qMax (worstPage, nsecs);
+        ++pages;
+        QCoreApplication::processEvents(); // a slice of the deferred highlighting
+    }
+    out << "  scrolling: " << totalPage / qMax (pages, 1) << " ns/page, worst: "
+        << worstPage << " ns\n";
+
+    /* typing and removing comment starts and quotes at a few places */
+    const char *typed[] = {"/*", "\"", "'", "<<EOF", "#"};
+    qint64 totalEdit = 0, worstEdit = 0;
+    int edits = 0;
+    for (int place = 0; place < 3; ++place)
+    {
+        const int bn = lines * place / 3;
+        showBlocks (highlighter, doc, bn, bn + VIEW_LINES - 1);
+        for (const char *str : typed)
+        {
+            QTextCursor cursor (doc->findBlockByNumber (bn));
+            timer.restart();
+            cursor.insertText (QString::fromLatin1 (str));
+            showBlocks (highlighter, doc, bn, bn + VIEW_LINES - 1);
+            qint64 nsecs = timer.nsecsElapsed();
+            QCoreApplication::processEvents();
+            cursor.movePosition (QTextCursor::StartOfBlock, QTextCursor::KeepAnchor);
+            timer.restart();
+            cursor.removeSelectedText();
+            showBlocks (highlighter, doc, bn, bn + VIEW_LINES - 1);
+            nsecs = qMax (nsecs, timer.nsecsElapsed());
+            QCoreApplication::processEvents();
+            totalEdit += nsecs;
+            worstEdit = qMax (worstEdit, nsecs);
+            ++edits;
+        }
+    }
+    out << "  editing: " << totalEdit / qMax (edits, 1) << " ns/edit, worst: "
+        << worstEdit << " ns\n";
+
+    /* the deferred highlighting should give the old states */
+    showBlocks (highlighter, doc, 0, lines - 1);
+    const QVector<int> newStates = blockStates (doc);
+    delete highlighter;
+    delete doc;
+    for (int i = 0; i < qMin (states.size(), newStates.size()); ++i)
+    {
+        if (newStates.at (i) != states.at (i))
+        {
+            out << "  editing: WRONG STATE at line " << i + 1
+                << " (corpus line " << i % corpusLines + 1 << ")\n";
+            return false;
+        }
+    }
+    return true;
+}
+/*************************/
+int main (int argc, char *argv[])
+{
+    if (qgetenv ("QT_QPA_PLATFORM").isEmpty())
+        qputenv ("QT_QPA_PLATFORM", "offscreen"); // headless
+    QApplication app (argc, argv);
+    QTextStream out (stdout);
+
+    bool update = false;
+    int repeat = DEFAULT_REPEAT;
+    QStringList langs;
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args.at (i) == "--update")
+            update = true;
+        else if (args.at (i) == "--repeat" && i + 1 < args.size())
+            repeat = qMax (1, args.at (++i).toInt());
+        else if (args.at (i) == "--help" || args.at (i) == "-h")
+        {
+            out << "Usage: highlighterbench [--update] [--repeat N] [language...]\n\n"\
+                   "--update      Write the golden files instead of comparing with them.\n"\
+                   "--repeat N    Repeat each corpus N times for timing (default: "
+                << DEFAULT_REPEAT << ").\n";
+            return 0;
+        }
+        else
+            langs << args.at (i);
+    }
+    if (langs.isEmpty())
+    {
+        for (const char *lang : languages)
+            langs << QString::fromLatin1 (lang);
+    }
+
+    const QDir corpusDir (CORPUS_DIR);
+    int failures = 0;
+    for (const QString &lang : langs)
+    {
+        out << lang << ":\n";
+        const QStringList files = corpusDir.entryList (QStringList() << lang + ".*", QDir::Files);
+        if (files.isEmpty())
+        {
+            out << "  no corpus file\n";
+            ++failures;
+            continue;
+        }
+        QFile file (corpusDir.filePath (files.first()));
+        if (!file.open (QIODevice::ReadOnly | QIODevice::Text))
+        {
+            out << "  cannot read " << file.fileName() << '\n';
+            ++failures;
+            continue;
+        }
+        QString text = QString::fromUtf8 (file.readAll());
+        if (text.endsWith ('\n'))
+            text.chop (1);
+
+        if (!checkGolden (lang, text, update, out))
+            ++failures;
+        if (!benchmark (lang, text, repeat, out))
+            ++failures;
+        out.flush(); // show the results of each language when they're ready
+    }
+
+    out << (failures == 0 ? "All passed." : QString ("%1 failure(s).").arg (failures)) << '\n';
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) Pedram Pourang (aka Tsu Jan) 2014 <tsujan2000@gmail.com>
+ *
+ * FeatherPad is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * FeatherPad is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <https://spdx.org/licenses/GPL-3.0+.html>
+ */
+
+
+#include <QApplication>
+#include <QPlainTextDocumentLayout>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include "textsearch.h"
+#include "searching.h"
+#include "replacing.h"
+
+#define VIEW_LINES 60 // the lines of a simulated viewport
+#define FIND_STEPS 1000 // the number of timed find-next calls
+#define MAX_PAGES 200 // the number of timed viewports
+#define MAX_GREEN_SEL 1000 // as in FPwin::replaceAll()
+#define DEFAULT_LINES 100000
+#define DEFAULT_LENGTH 80
+
+using namespace FeatherPad;
+
+/* the searches that are timed */
+struct SearchCase {
+    const char *name;
+    const char *str;
+    Qt::CaseSensitivity cs;
+    bool wholeWords;
+    bool regex;
+};
+static const SearchCase searchCases[] = {
+    {"literal", "needle", Qt::CaseInsensitive, false, false},
+    {"case sensitive", "Needle", Qt::CaseSensitive, false, false},
+    {"whole words", "needle", Qt::CaseInsensitive, true, false},
+    {"rare", "haystack_needle", Qt::CaseInsensitive, false, false},
+    {"multi-line", "needle;\n", Qt::CaseInsensitive, false, false},
+    {"regex", "ne+dle\\w*", Qt::CaseInsensitive, false, true},
+    {"multi-line regex", "needle;\\n\\s*\\w+", Qt::CaseInsensitive, false, true}
+};
+
+static const char *words[] = {
+    "value", "index", "count", "result", "buffer", "needle", "line", "text",
+    "block", "Needle", "cursor", "needles", "size", "haystack", "item", "data"
+};
+static const int wordCount = sizeof (words) / sizeof (words[0]);
+
+/* a small generator, so that documents are the same on all systems */
+static quint32 seed = 1;
+static int nextRandom (int n)
+{
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 16) % n;
+}
+/*************************/
+// "code": indented statements, some of which end with "needle;".
+// "prose": sentences. "single": prose without line breaks.
+static QString makeText (int lines, int length, const QString &shape)
+{
+    seed = 1;
+    const bool code = shape == "code";
+    QString text;
+    text.reserve (lines * (length + 1));
+    for (int i = 0; i < lines; ++i)
+    {
+        if (i > 0)
+            text += shape == "single" ? QLatin1Char (' ') : QLatin1Char ('\n');
+        QString line;
+        if (code)
+        {
+            line = QString (4 * nextRandom (4), ' ');
+            if (i % 997 == 0)
+                line += "haystack_needle = ";
+        }
+        const int lineLength = length / 2 + nextRandom (length + 1);
+        while (line.length() < lineLength)
+        {
+            line += QLatin1String (words[nextRandom (wordCount)]);
+            const char *separator = code ? (nextRandom (3) == 0 ? " (" : ", ")
+                                         : (nextRandom (8) == 0 ? ". " : " ");
+            line += QLatin1String (separator);
+        }
+        if (code)
+            line += i % 50 == 0 ? "needle;" : "0);";
+        text += line;
+    }
+    return text;
+}
+/*************************/
+static QTextDocument *makeDocument (const QString &text)
+{
+    QTextDocument *doc = new QTextDocument;
+    doc->setDocumentLayout (new QPlainTextDocumentLayout (doc));
+    doc->setPlainText (text);
+    return doc;
+}
+/*************************/
+// Does what TextEdit::plainTextRange() does.
+static QString plainText (QTextDocument *doc, int from, int to)
+{
+    QTextCursor cursor (doc);
+    cursor.setPosition (from);
+    cursor.setPosition (to, QTextCursor::KeepAnchor);
+    QString text = cursor.selectedText();
+    text.replace (QChar::ParagraphSeparator, QLatin1Char ('\n'));
+    return text;
+}
+/*************************/
+static QString snapshot (QTextDocument *doc)
+{
+    return plainText (doc, 0, doc->characterCount() - 1);
+}
+/*************************/
+static int countMatches (const TextSearch &search, const QString &text)
+{
+    int count = 0, pos = 0, l;
+    while ((pos = search.indexIn (text, pos, -1, &l)) >= 0)
+    {
+        ++count;
+        pos += l;
+    }
+    return count;
+}
+/*************************/
+// The matches of a single-line literal search should be those of QTextDocument::find().
+static int documentCount (QTextDocument *doc, const SearchCase &c)
+{
+    QTextDocument::FindFlags flags = 0;
+    if (c.cs == Qt::CaseSensitive)
+        flags |= QTextDocument::FindCaseSensitively;
+    if (c.wholeWords)
+        flags |= QTextDocument::FindWholeWords;
+    int count = 0;
+    QTextCursor cursor (doc);
+    while (!(cursor = doc->find (QString::fromLatin1 (c.str), cursor, flags)).isNull())
+        ++count;
+    return count;
+}
+/*************************/
+static void printTime (QTextStream &out, const char *name, qint64 total, int calls, qint64 worst)
+{
+    out << "  " << name << ": " << total / qMax (calls, 1) << " ns/call, worst: "
+        << worst << " ns\n";
+}
+/*************************/
+// Does what FPwin::finding() does on F3 and Shift+F3, from the start and end.
+static void timeFinding (QTextStream &out, TextSearch &search, const QString &text, bool backward)
+{
+    QElapsedTimer timer;
+    qint64 total = 0, worst = 0;
+    int pos = backward ? text.length() : 0, l = 0, calls = 0;
+    while (calls < FIND_STEPS)
+    {
+        timer.start();
+        int found = backward
+                    ? search.lastIndexIn (text, pos - (search.isRegex() ? 1 : search.length()), &l)
+                    : search.indexIn (text, pos, -1, &l);
+        if (found < 0) // wrap around
+        {
+            pos = backward ? text.length() : 0;
+            found = backward
+                    ? search.lastIndexIn (text, pos - (search.isRegex() ? 1 : search.length()), &l)
+                    : search.indexIn (text, pos, -1, &l);
+        }
+        const qint64 nsecs = timer.nsecsElapsed();
+        total += nsecs;
+        worst = qMax (worst, nsecs);
+        ++calls;
+        if (found < 0) break;
+        pos = backward ? found : found + l;
+    }
+    printTime (out, backward ? "finding backward" : "finding forward", total, calls, worst);
+}
+/*************************/
+// Does what FPwin::hlight() does when the index isn't ready:
+// the visible text is searched, with a character before and after it.
+static void timeHighlighting (QTextStream &out, TextSearch &search, int strLength, QTextDocument *doc)
+{
+    const int lines = doc->blockCount();
+    const int step = qMax (VIEW_LINES, lines / MAX_PAGES);
+    QElapsedTimer timer;
+    qint64 total = 0, worst = 0;
+    int pages = 0;
+    search.setTextRevision (-1);
+    for (int first = 0; first < lines; first += step)
+    {
+        timer.start();
+        const int startPos = doc->findBlockByNumber (first).position();
+        const QTextBlock last = doc->findBlockByNumber (qMin (first + VIEW_LINES, lines) - 1);
+        const int endLimit = last.position() + last.length() - 1;
+        const int from = qMax (startPos - 1, 0);
+        const int to = qMin (endLimit + strLength + 1, doc->characterCount() - 1);
+        const QString str = plainText (doc, from, to);
+        int pos = 0, l, count = 0;
+        while ((pos = search.indexIn (str, pos, endLimit - from, &l)) >= 0)
+        {
+            ++count;
+            pos += l;
+        }
+        const qint64 nsecs = timer.nsecsElapsed();
+        total += nsecs;
+        worst = qMax (worst, nsecs);
+        ++pages;
+    }
+    out << "  highlighting: " << total / qMax (pages, 1) << " ns/page, worst: "
+        << worst << " ns\n";
+}
+/*************************/
+// Builds the search index in a thread, as SearchIndex does.
+// Returns the number of matches.
+static int timeIndex (QTextStream &out, const SearchCase &c, const QString &text)
+{
+    int count = 0;
+    Searching *thread = new Searching (text, QString::fromLatin1 (c.str), c.cs, c.wholeWords, c.regex, 0, 0);
+    QObject::connect (thread, &Searching::found, thread, [&count] (int, const QVector<int> positions,
+                                                                   const QVector<int>, int, bool) {
+        count += positions.size();
+    }, Qt::DirectConnection);
+    QElapsedTimer timer;
+    timer.start();
+    thread->start();
+    thread->wait();
+    out << "  index: " << timer.nsecsElapsed() / 1000000 << " ms\n";
+    delete thread;
+    return count;
+}
+/*************************/
+// Does what FPwin::replaceAll() does, with the edit of the document.
+// Returns false if a match is left.
+static bool timeReplaceAll (QTextStream &out, const SearchCase &c, const QString &origText)
+{
+    const QString str = QString::fromLatin1 (c.str);
+    const QString replaceWith = "<->";
+    QTextDocument *doc = makeDocument (origText);
+    QElapsedTimer timer;
+    timer.start();
+    const QString text = snapshot (doc);
+    int count = 0;
+    QTextCursor cursor (doc);
+    if (c.regex)
+    {
+        QString newText;
+        int first = -1, last = -1;
+        Replacing *thread = new Replacing (text, str, replaceWith, c.cs, c.wholeWords, MAX_GREEN_SEL);
+        QObject::connect (thread, &Replacing::completed, thread,
+                          [&] (const QString nt, int f, int l, int n, const QVector<int>) {
+            newText = nt;
+            first = f;
+            last = l;
+            count = n;
+        }, Qt::DirectConnection);
+        thread->start();
+        thread->wait();
+        delete thread;
+        if (count > 0)
+        {
+            cursor.setPosition (first);
+            cursor.setPosition (last, QTextCursor::KeepAnchor);
+            cursor.insertText (newText);
+        }
+    }
+    else
+    {
+        TextSearch search (str, c.cs, c.wholeWords);
+        QVector<int> matches;
+        int pos = 0;
+        while ((pos = search.indexIn (text, pos)) >= 0)
+        {
+            matches.append (pos);
+            pos += str.length();
+        }
+        count = matches.size();
+        cursor.beginEditBlock();
+        if (count <= MAX_GREEN_SEL)
+        {
+            for (int i = count - 1; i >= 0; --i)
+            {
+                cursor.setPosition (matches.at (i));
+                cursor.setPosition (matches.at (i) + str.length(), QTextCursor::KeepAnchor);
+                cursor.insertText (replaceWith);
+            }
+        }
+        else
+        {
+            const int first = matches.first();
+            const int last = matches.last() + str.length();
+            QString newText;
+            int prev = first;
+            for (int i = 0; i < count; ++i)
+            {
+                newText += text.midRef (prev, matches.at (i) - prev);
+                newText += replaceWith;
+                prev = matches.at (i) + str.length();
+            }
+            cursor.setPosition (first);
+            cursor.setPosition (last, QTextCursor::KeepAnchor);
+            cursor.insertText (newText);
+        }
+        cursor.endEditBlock();
+    }
+    out << "  replacing all: " << count << " replacements, "
+        << timer.nsecsElapsed() / 1000000 << " ms\n";
+
+    TextSearch search (str, c.cs, c.wholeWords, c.regex);
+    const int left = countMatches (search, snapshot (doc));
+    delete doc;
+    if (left > 0)
+    {
+        out << "  replacing all: WRONG, " << left << " matches are left\n";
+        return false;
+    }
+    return true;
+}
+/*************************/
+// Returns false if the results of different ways of searching don't agree.
+static bool benchmark (QTextStream &out, const SearchCase &c, const QString &origText)
+{
+    bool ok = true;
+    QTextDocument *doc = makeDocument (origText);
+    const QString text = snapshot (doc);
+    TextSearch search (QString::fromLatin1 (c.str), c.cs, c.wholeWords, c.regex);
+    search.setTextRevision (0);
+
+    QElapsedTimer timer;
+    timer.start();
+    const int count = countMatches (search, text);
+    out << "  matches: " << count << " (" << timer.nsecsElapsed() / 1000000 << " ms)\n";
+    if (!c.regex && !QString::fromLatin1 (c.str).contains ('\n'))
+    {
+        const int expected = documentCount (doc, c);
+        if (expected != count)
+        {
+            out << "  matches: WRONG, QTextDocument finds " << expected << '\n';
+            ok = false;
+        }
+    }
+
+    timeFinding (out, search, text, false);
+    timeFinding (out, search, text, true);
+    timeHighlighting (out, search, qstrlen (c.str), doc);
+    delete doc;
+
+    const int indexed = timeIndex (out, c, text);
+    if (indexed != count)
+    {
+        out << "  index: WRONG, " << indexed << " matches\n";
+        ok = false;
+    }
+
+    if (!timeReplaceAll (out, c, origText))
+        ok = false;
+    return ok;
+}
+/*************************/
+int main (int argc, char *argv[])
+{
+    if (qgetenv ("QT_QPA_PLATFORM").isEmpty())
+        qputenv ("QT_QPA_PLATFORM", "offscreen"); // headless
+    QApplication app (argc, argv);
+    QTextStream out (stdout);
+
+    int lines = DEFAULT_LINES;
+    int length = DEFAULT_LENGTH;
+    QString shape = "code";
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args.at (i) == "--lines" && i + 1 < args.size())
+            lines = qMax (1, args.at (++i).toInt());
+        else if (args.at (i) == "--length" && i + 1 < args.size())
+            length = qMax (1, args.at (++i).toInt());
+        else if (args.at (i) == "--shape" && i + 1 < args.size())
+            shape = args.at (++i);
+        else
+        {
+            out << "Usage: searchbench [--lines N] [--length N] [--shape code|prose|single]\n\n"\
+                   "--lines N     The number of generated lines (default: " << DEFAULT_LINES << ").\n"\
+                   "--length N    Their average length (default: " << DEFAULT_LENGTH << ").\n"\
+                   "--shape S     Indented code, prose or prose without line breaks (default: code).\n";
+            return args.at (i) == "--help" || args.at (i) == "-h" ? 0 : 1;
+        }
+    }
+    if (shape != "code" && shape != "prose" && shape != "single")
+    {
+        out << "Unknown shape: " << shape << '\n';
+        return 1;
+    }
+
+    const QString text = makeText (lines, length, shape);
+    out << "Document: " << lines << " lines (" << shape << "), "
+        << text.length() << " characters\n";
+    int failures = 0;
+    for (const SearchCase &c : searchCases)
+    {
+        out << c.name << ":\n";
+        if (!benchmark (out, c, text))
+            ++failures;
+        out.flush(); // show the results of each case when they're ready
+    }
+
+    out << (failures == 0 ? "All passed." : QString ("%1 failure(s).").arg (failures)) << '\n';
+    return failures == 0 ? 0 : 1;
+}
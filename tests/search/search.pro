@@ -0,0 +1,23 @@
+# A headless benchmark of searching and replacing on generated documents.
+# Build and run it with:
+#   qmake && make && ./searchbench [--lines N] [--length N] [--shape code|prose|single]
+
+QT += core gui \
+      widgets
+
+TARGET = searchbench
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+FP_SRC = ../../featherpad
+INCLUDEPATH += $$FP_SRC
+
+SOURCES += main.cpp \
+           $$FP_SRC/textsearch.cpp \
+           $$FP_SRC/searching.cpp \
+           $$FP_SRC/replacing.cpp
+
+HEADERS += $$FP_SRC/textsearch.h \
+           $$FP_SRC/searching.h \
+           $$FP_SRC/replacing.h